@@ -0,0 +1,294 @@
+#include "BatchProcessor.h"
+#include "ContourExtractor.h"
+#include "RegionStats.h"
+#include "Segmenter3D.h"
+#include "VolumeCache.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+const size_t MB = 1024 * 1024;
+
+// Bytes por píxel de un corte en vuelo: hu (2) + original, contraste, procesada y
+// máscara (1 cada una) + overlay (3) + tensores float de la red (~6)
+const size_t BYTES_PIXEL_EN_VUELO = 16;
+// Volumen 3D: máscara (1) + etiquetas de componentes conexas (4) por vóxel
+const size_t BYTES_VOXEL_3D = 5;
+
+// Píxeles por corte; si el escaneo no pudo leer Rows/Columns se asume 512x512
+size_t pixelesCorte(const SerieDicom& serie) {
+    return (serie.alto > 0 && serie.ancho > 0) ? (size_t)serie.alto * serie.ancho : 512u * 512u;
+}
+
+} // namespace
+
+BatchProcessor::BatchProcessor(const ConfiguracionLote& config) : config(config) {}
+
+int BatchProcessor::ejecutar() {
+    // 1. Índice de series: solo encabezados, así que ocupa poco aunque el árbol tenga
+    // miles de archivos. Una carpeta sin DICOM propios se recorre entera.
+    bool recursivo = config.recursivo || DicomHandler::buscarArchivos(config.carpeta).empty();
+    std::vector<SerieDicom> series = DicomHandler::descubrirSeries(config.carpeta, recursivo);
+    if (series.empty()) {
+        std::cout << "ERROR: No se encontraron imagenes medicas en la carpeta." << std::endl;
+        return -1;
+    }
+
+    size_t maxCortes = 0, maxPixeles = 0, bytesSeries = 0;
+    for (const SerieDicom& s : series) {
+        maxCortes = std::max(maxCortes, s.archivos.size());
+        maxPixeles = std::max(maxPixeles, pixelesCorte(s));
+        bytesSeries += s.bytesVolumen();
+    }
+
+    // La caché de volumen guarda una copia sin comprimir de cada serie: dentro del árbol de
+    // entrada (un archivo de solo lectura o de varios TB) duplicaría lo que se recorre
+    if (!config.carpetaCacheVolumen.empty()) {
+        if (!VolumeCache::raizPermitida(config.carpetaCacheVolumen, config.carpeta)) {
+            config.carpetaCacheVolumen.clear();
+        } else {
+            std::cout << "[LOTE] Cache de volumen en " << config.carpetaCacheVolumen << ": hasta "
+                      << bytesSeries / MB << " MB para " << series.size() << " series." << std::endl;
+        }
+    }
+
+    int hilos = config.hilos > 0 ? config.hilos : (int)std::thread::hardware_concurrency();
+    if (hilos < 1) hilos = 1;
+    if (hilos > (int)maxCortes) hilos = (int)maxCortes;
+
+    // 2. Reparto del techo de memoria: 1/4 para los cortes en vuelo de los hilos,
+    // 1/4 para la cola de exportación y 1/2 para el volumen de la serie actual
+    ConfiguracionExportacion confExport = config.exportacion;
+    const size_t techo = config.memoriaMaxMB * MB;
+    if (techo > 0) {
+        size_t porHilo = (size_t)std::max(1, config.tamLoteDNN) * maxPixeles * BYTES_PIXEL_EN_VUELO;
+        hilos = std::max(1, std::min(hilos, (int)((techo / 4) / porHilo)));
+        confExport.maxPendientes = std::max<size_t>(8, (techo / 4) / (maxPixeles * 3));
+        std::cout << "[LOTE] Techo de memoria " << config.memoriaMaxMB << " MB: " << hilos << " hilos, cola de "
+                  << confExport.maxPendientes << " imagenes, volumenes de hasta " << techo / 2 / MB << " MB." << std::endl;
+    }
+
+    // El paralelismo va por cortes: evitamos que OpenCV lance además sus propios hilos
+    // dentro de cada filtro (sobre-suscripción de núcleos).
+    if (hilos > 1) cv::setNumThreads(1);
+
+    // Escritura en segundo plano: los hilos de proceso no esperan al disco
+    confExport.hilos = config.hilosEscritura > 0 ? config.hilosEscritura : std::max(2, hilos / 2);
+    ResultExporter exportador(confExport);
+
+    // Un ImageProcessor por hilo para todo el lote. El modelo se lee una sola vez y
+    // el pool presta a cada hilo su propia instancia de la red (forward() no es reentrante)
+    std::shared_ptr<InferencePool> redes;
+    if (config.pipeline.usarDNN) redes = InferencePool::cargar(config.rutaModelo, hilos);
+    std::vector<std::unique_ptr<ImageProcessor>> procesadores;
+    for (int h = 0; h < hilos; h++) {
+        procesadores.emplace_back(new ImageProcessor());
+        procesadores.back()->compartirRed(redes);
+        procesadores.back()->configurarInferencia(std::max(1, config.tamLoteDNN));
+    }
+
+    std::cout << "[LOTE] " << series.size() << " series, " << hilos << " hilos, "
+              << confExport.hilos << " escritores." << std::endl;
+
+    // 3. Serie a serie: al terminar una, su volumen se libera antes de cargar la siguiente.
+    // Con varias series, los resultados replican el árbol de carpetas de origen.
+    Totales totales;
+    int64 t0 = cv::getTickCount();
+    for (size_t s = 0; s < series.size(); s++) {
+        std::string subcarpeta;
+        if (series.size() > 1) {
+            const std::string& dir = series[s].directorio;
+            subcarpeta = dir.size() > config.carpeta.size() ? dir.substr(config.carpeta.size() + 1) : "serie";
+            if (!series[s].unicaEnDirectorio) subcarpeta += "/" + series[s].uid;
+            std::cout << "[LOTE] Serie " << s + 1 << "/" << series.size() << ": " << subcarpeta
+                      << " (" << series[s].archivos.size() << " cortes)" << std::endl;
+        }
+        procesarSerie(series[s], subcarpeta, procesadores, exportador, totales);
+    }
+    exportador.esperar();
+    double segundos = (cv::getTickCount() - t0) / cv::getTickFrequency();
+
+    int ok = totales.procesados;
+    std::cout << "[LOTE] Procesados: " << ok << "  Fallidos: " << totales.fallidos
+              << "  Tiempo: " << segundos << " s  ("
+              << (segundos > 0 ? ok / segundos : 0.0) << " cortes/s)" << std::endl;
+    exportador.imprimirResumen();
+    if (config.pipeline.usarDNN && totales.muestrasLatencia > 0) {
+        std::cout << "[LOTE] Filtro de ruido " << ImageProcessor::nombrePresetRuido(config.pipeline.presetRuido)
+                  << ": " << totales.sumaLatenciaMs / totales.muestrasLatencia << " ms/corte por hilo." << std::endl;
+    }
+
+    return totales.fallidos > 0 ? 1 : 0;
+}
+
+void BatchProcessor::procesarSerie(const SerieDicom& serie, const std::string& subcarpeta,
+                                   std::vector<std::unique_ptr<ImageProcessor>>& procesadores,
+                                   ResultExporter& exportador, Totales& totales) {
+    const std::vector<std::string>& archivos = serie.archivos;
+    const size_t techo = config.memoriaMaxMB * MB;
+    bool usar3D = config.pipeline.usar3D && (config.pipeline.modo == 1 || config.pipeline.modo == 2);
+
+    // 1. Cargar la serie como un único volumen (caché mapeada o lectura paralela de los
+    // archivos) si cabe en la mitad del techo; si no, se decodifica corte a corte
+    DicomHandler dicomVolumen;
+    VolumenCT volumen;
+    std::unique_ptr<VolumeCache> cacheVolumen;
+    size_t bytesVolumen = serie.bytesVolumen();
+    if (usar3D) bytesVolumen += archivos.size() * pixelesCorte(serie) * BYTES_VOXEL_3D;
+    bool cabe = techo == 0 || bytesVolumen <= techo / 2;
+    if (cabe) {
+        if (!config.carpetaCacheVolumen.empty()) {
+            cacheVolumen = VolumeCache::paraSerie(config.carpetaCacheVolumen, serie, config.carpeta);
+        }
+        int64 tCarga = cv::getTickCount();
+        if (dicomVolumen.cargarSerieDicom(serie, volumen, cacheVolumen.get())) {
+            std::cout << "[LOTE] Volumen cargado en "
+                      << (cv::getTickCount() - tCarga) * 1000.0 / cv::getTickFrequency() << " ms." << std::endl;
+        }
+    } else {
+        std::cout << "[LOTE] La serie (" << bytesVolumen / MB << " MB) no cabe en el techo de memoria: "
+                  << "se procesa corte a corte" << (usar3D ? " y sin segmentacion 3D." : ".") << std::endl;
+    }
+
+    // Segmentación volumétrica (Hueso/Pulmón): una sola vez, antes de repartir los cortes
+    cv::Mat mascaraVolumen;
+    if (usar3D && !volumen.vacio()) {
+        Segmenter3D seg3D;
+        int64 t3D = cv::getTickCount();
+        bool hueso = (config.pipeline.modo == 1);
+        mascaraVolumen = hueso ? seg3D.segmentarHueso3D(volumen, config.pipeline.usarMorf)
+                               : seg3D.segmentarPulmon3D(volumen, config.pipeline.usarMorf);
+        seg3D.imprimirResumen(hueso ? "Hueso" : "Pulmon");
+        std::cout << "[3D] Segmentacion en "
+                  << (cv::getTickCount() - t3D) * 1000.0 / cv::getTickFrequency() << " ms." << std::endl;
+    }
+
+    // Los nombres de archivo solo se repiten entre series: cada una en su subcarpeta
+    std::string prefijo;
+    if (!subcarpeta.empty()) {
+        ResultExporter::crearDirectorios(config.exportacion.carpeta + "/" + subcarpeta);
+        prefijo = subcarpeta + "/";
+    }
+
+    // Estadísticas de la ROI: cada hilo suma sus cortes al agregado de la serie
+    RegionStats estadisticas;
+    estadisticas.reiniciar((int)archivos.size(), volumen.vacio() ? serie.espaciado : volumen.espaciado,
+                           ImageProcessor::nombreModo(config.pipeline.modo));
+    // Contornos vectoriales: cada hilo rellena los de sus cortes (posiciones distintas del vector)
+    bool conContornos = config.exportarContornos || config.soloContornos;
+    std::vector<ContornosCorte> contornos(conContornos ? archivos.size() : 0);
+    ContourExtractor extractor;
+
+    int hilos = std::min((int)procesadores.size(), (int)archivos.size());
+    std::atomic<size_t> siguiente(0);
+    std::atomic<int> procesados(0);
+    std::atomic<int> fallidos(0);
+    std::mutex mtxLatencia;
+
+    // 2. Trabajador: toma el siguiente bloque libre de cortes hasta agotar la serie.
+    // Cada bloque pasa por la red en una sola inferencia (lote NCHW).
+    const size_t tamBloque = (size_t)std::max(1, config.tamLoteDNN);
+    auto trabajador = [&](ImageProcessor& proc) {
+        DicomHandler dicomIO;
+
+        size_t inicio;
+        while ((inicio = siguiente.fetch_add(tamBloque)) < archivos.size()) {
+            size_t fin = std::min(inicio + tamBloque, archivos.size());
+
+            std::vector<cv::Mat> cortes, mascaras, filtradas;
+            std::vector<size_t> indices;
+            // Cortes filtrados en una ejecución anterior (misma serie, preset, CLAHE, modelo y ventana)
+            bool usarCapa = cacheVolumen && cacheVolumen->abierta() && !volumen.vacio() && config.pipeline.usarDNN;
+            int preset = proc.presetEfectivo(config.pipeline.presetRuido);
+            uint64_t huellaFiltro = proc.huellaFiltro(config.pipeline.presetRuido);
+            for (size_t i = inicio; i < fin; i++) {
+                cv::Mat imgOrig = volumen.vacio() ? dicomIO.cargarImagenDicom(archivos[i]) : volumen.corte((int)i);
+                if (imgOrig.empty()) {
+                    fallidos++;
+                    continue;
+                }
+                cv::Mat mascaraCorte;
+                if (!mascaraVolumen.empty()) {
+                    mascaraCorte = mascaraVolumen.rowRange((int)i * volumen.alto, ((int)i + 1) * volumen.alto);
+                }
+                cortes.push_back(imgOrig);
+                mascaras.push_back(mascaraCorte);
+                filtradas.push_back(usarCapa ? cacheVolumen->corteFiltrado((int)i, preset, config.pipeline.usarCLAHE,
+                                                                           huellaFiltro)
+                                             : cv::Mat());
+                indices.push_back(i);
+            }
+
+            std::vector<ResultadoPipeline> res = proc.procesarLote(cortes, config.pipeline, mascaras, filtradas);
+            if (usarCapa) {
+                // Si la red falló en este lote, lo calculado es del respaldo: se guarda como tal
+                preset = proc.presetEfectivo(config.pipeline.presetRuido);
+                huellaFiltro = proc.huellaFiltro(config.pipeline.presetRuido);
+                for (size_t k = 0; k < res.size(); k++) {
+                    if (!filtradas[k].empty()) continue;
+                    cacheVolumen->guardarFiltrado((int)indices[k], preset, config.pipeline.usarCLAHE, huellaFiltro,
+                                                  res[k].procesada);
+                }
+            }
+
+            for (size_t k = 0; k < res.size(); k++) {
+                EstadisticasRegion e;
+                RegionStats::medir(res[k].hu, res[k].mascara, e);
+                estadisticas.actualizarCorte((int)indices[k], e);
+                if (conContornos) {
+                    // Con VER BORDES ya vienen extraídos del pipeline
+                    if (config.pipeline.verBordes) contornos[indices[k]] = std::move(res[k].contornos);
+                    else extractor.extraer(res[k].mascara, contornos[indices[k]]);
+                }
+                if (config.soloContornos) {
+                    procesados++;
+                    continue;
+                }
+
+                const std::string& ruta = archivos[indices[k]];
+                std::string fName = prefijo + ruta.substr(ruta.find_last_of("/\\") + 1);
+                // Los resultados del lote son imágenes nuevas: se encolan sin copiar.
+                // Con la cola llena se espera (contrapresión: la memoria no crece sin límite).
+                exportador.encolar(fName, res[k].original, res[k].procesada, res[k].mascara, res[k].final,
+                                   false, true);
+                procesados++;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mtxLatencia);
+        totales.sumaLatenciaMs += proc.latenciaRuido(config.pipeline.presetRuido);
+        totales.muestrasLatencia++;
+    };
+
+    // 3. Lanzar el pool para esta serie
+    std::vector<std::thread> pool;
+    for (int h = 0; h < hilos; h++) pool.emplace_back(trabajador, std::ref(*procesadores[h]));
+    for (auto& t : pool) t.join();
+
+    totales.procesados += procesados.load();
+    totales.fallidos += fallidos.load();
+
+    // 4. Estadísticas del estudio junto a sus imágenes
+    std::string carpetaSerie = config.exportacion.carpeta + (subcarpeta.empty() ? "" : "/" + subcarpeta);
+    ResultExporter::crearDirectorios(carpetaSerie);
+    estadisticas.imprimirResumen();
+    if (!estadisticas.exportarCSV(carpetaSerie + "/estadisticas.csv", archivos) ||
+        !estadisticas.exportarJSON(carpetaSerie + "/estadisticas.json", archivos)) {
+        std::cout << "[AVISO] No se pudieron guardar las estadisticas en " << carpetaSerie << std::endl;
+    }
+    if (conContornos) {
+        size_t puntos = 0;
+        for (const ContornosCorte& c : contornos) puntos += ContourExtractor::numPuntos(c);
+        if (ContourExtractor::exportarJSON(carpetaSerie + "/contornos.json", contornos, archivos,
+                                           volumen.vacio() ? serie.espaciado : volumen.espaciado,
+                                           ImageProcessor::nombreModo(config.pipeline.modo))) {
+            std::cout << "[LOTE] Contornos: " << puntos << " puntos en " << carpetaSerie << "/contornos.json" << std::endl;
+        } else {
+            std::cout << "[AVISO] No se pudieron guardar los contornos en " << carpetaSerie << std::endl;
+        }
+    }
+}
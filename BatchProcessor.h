@@ -0,0 +1,55 @@
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "DicomHandler.h"
+#include "ImageProcessor.h"
+#include "ResultExporter.h"
+
+// Configuración del modo lote (sin ventana)
+struct ConfiguracionLote {
+    std::string carpeta;
+    ConfiguracionPipeline pipeline;
+    int hilos = 0;                          // 0 = todos los núcleos disponibles
+    int tamLoteDNN = 8;                     // Cortes por inferencia de la red
+    std::string rutaModelo = "dncnn.onnx";
+    ConfiguracionExportacion exportacion;   // Formato y compresión de los resultados
+    int hilosEscritura = 0;                 // 0 = la mitad de los hilos de proceso (mínimo 2)
+    std::string carpetaCacheVolumen;        // Cachés mapeadas de las series (y sus cortes filtrados); vacío = sin caché
+    bool recursivo = false;                 // Recorre las subcarpetas (automático si la carpeta no tiene DICOM)
+    size_t memoriaMaxMB = 0;                // Techo de memoria del lote (0 = sin límite)
+    bool exportarContornos = false;         // contornos.json por serie (polígonos de la máscara)
+    bool soloContornos = false;             // Solo los contornos: sin las cuatro imágenes por corte
+};
+
+// Procesa una o varias series DICOM en paralelo con un pool de hilos.
+// Cada hilo tiene su propio DicomHandler e ImageProcessor; las instancias de la red salen de un InferencePool común.
+// Las series de un árbol de carpetas se procesan de una en una ("streaming"): solo la
+// serie actual está en memoria, y con un techo de memoria las que no caben como
+// volumen se decodifican corte a corte.
+class BatchProcessor {
+public:
+    explicit BatchProcessor(const ConfiguracionLote& config);
+
+    // Devuelve el código de salida del programa (0 = OK)
+    int ejecutar();
+
+private:
+    struct Totales {
+        int procesados = 0;
+        int fallidos = 0;
+        double sumaLatenciaMs = 0.0;   // Latencia media del filtro de ruido de cada hilo, sumada
+        int muestrasLatencia = 0;
+    };
+
+    // Procesa una serie completa; los resultados van a <carpeta de exportación>/<subcarpeta>
+    void procesarSerie(const SerieDicom& serie, const std::string& subcarpeta,
+                       std::vector<std::unique_ptr<ImageProcessor>>& procesadores,
+                       ResultExporter& exportador, Totales& totales);
+
+    ConfiguracionLote config;
+};
+
+#endif
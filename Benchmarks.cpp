@@ -0,0 +1,333 @@
+// Microbenchmarks de cada etapa sobre cortes reales del dataset (estilo Google Benchmark).
+// Uso: IntegradorBench [carpeta] [--filtro texto] [--json salida.json] [--min-tiempo s]
+//                      [--cortes N] [--modelo ruta.onnx]
+// La salida JSON sigue el formato de Google Benchmark ("context" + "benchmarks"), así que
+// se puede comparar entre compilaciones con tools/compare.py de esa librería.
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "ContourExtractor.h"
+#include "DicomHandler.h"
+#include "ImageProcessor.h"
+#include "ResultExporter.h"
+#include "SliceStore.h"
+
+using namespace std;
+
+static const char* CARPETA_POR_DEFECTO =
+    "../data/ct_low_dose/CT_low_dose_reconstruction_dataset/Original_Data/Quarter_Dose/"
+    "3mm_Slice_Thickness/Soft_Kernel_(B30)/L109";
+
+// --- ESTADO DE UNA EJECUCIÓN ---
+// Igual que benchmark::State: el cuerpo se repite mientras seguir() devuelva true.
+// La primera iteración es de calentamiento y no se mide.
+class Estado {
+public:
+    Estado(double minSegundos, long long maxIteraciones)
+        : minSegundos(minSegundos), maxIteraciones(maxIteraciones) {}
+
+    bool seguir() {
+        int64 ahora = cv::getTickCount();
+        clock_t cpuAhora = clock();
+        if (iteracion > 0) {
+            // Cierra la iteración anterior (la 0 es el calentamiento)
+            if (iteracion > 1) tiemposMs.push_back((ahora - inicioIter) * 1000.0 / cv::getTickFrequency());
+            else { inicioTotal = ahora; cpuInicio = cpuAhora; }
+        }
+        double total = (ahora - inicioTotal) / cv::getTickFrequency();
+        if (iteracion > 1 && (total >= minSegundos || (long long)tiemposMs.size() >= maxIteraciones)) {
+            cpuTotalMs = (cpuAhora - cpuInicio) * 1000.0 / CLOCKS_PER_SEC;
+            return false;
+        }
+        iteracion++;
+        inicioIter = cv::getTickCount();
+        return true;
+    }
+
+    // Índice de la iteración actual (para rotar entre los cortes de entrada)
+    size_t indice() const { return (size_t)iteracion; }
+
+    void omitir(const string& motivo) { motivoOmision = motivo; }
+
+    vector<double> tiemposMs;
+    double cpuTotalMs = 0.0;
+    string motivoOmision;
+
+private:
+    double minSegundos;
+    long long maxIteraciones;
+    long long iteracion = 0;
+    int64 inicioIter = 0, inicioTotal = 0;
+    clock_t cpuInicio = 0;
+};
+
+struct Resultado {
+    string nombre;
+    long long iteraciones;
+    double mediaMs, medianaMs, desvMs, minMs, cpuMs;
+};
+
+// Cortes de entrada ya preparados para un tamaño
+struct Entradas {
+    int tam;
+    vector<cv::Mat> hu;          // CV_16S
+    vector<cv::Mat> ventana;     // 8 bits tras la ventana HU
+    vector<cv::Mat> mascara;     // Máscara de hueso (para el overlay)
+};
+
+struct Benchmark {
+    string nombre;
+    bool dependeDelTamano;
+    function<void(Estado&, const Entradas&)> cuerpo;
+};
+
+static Resultado resumir(const string& nombre, const Estado& e) {
+    Resultado r{nombre, (long long)e.tiemposMs.size(), 0, 0, 0, 0, 0};
+    if (e.tiemposMs.empty()) return r;
+    vector<double> t = e.tiemposMs;
+    sort(t.begin(), t.end());
+    double suma = 0;
+    for (double v : t) suma += v;
+    r.mediaMs = suma / t.size();
+    r.medianaMs = t[t.size() / 2];
+    r.minMs = t.front();
+    double var = 0;
+    for (double v : t) var += (v - r.mediaMs) * (v - r.mediaMs);
+    r.desvMs = sqrt(var / t.size());
+    r.cpuMs = e.cpuTotalMs / t.size();
+    return r;
+}
+
+static bool exportarJSON(const string& ruta, const vector<Resultado>& res, const string& carpeta) {
+    ofstream f(ruta);
+    if (!f) return false;
+    time_t ahora = time(nullptr);
+    char fecha[64];
+    strftime(fecha, sizeof(fecha), "%Y-%m-%dT%H:%M:%S", localtime(&ahora));
+    f << "{\n  \"context\": {\n"
+      << "    \"date\": \"" << fecha << "\",\n"
+      << "    \"executable\": \"IntegradorBench\",\n"
+      << "    \"num_cpus\": " << cv::getNumberOfCPUs() << ",\n"
+      << "    \"opencv_version\": \"" << CV_VERSION << "\",\n"
+      << "    \"dataset\": \"" << ResultExporter::escaparJSON(carpeta) << "\"\n"
+      << "  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < res.size(); i++) {
+        const Resultado& r = res[i];
+        string nombre = ResultExporter::escaparJSON(r.nombre);
+        f << (i ? ",\n" : "\n")
+          << "    {\"name\": \"" << nombre << "\", \"run_name\": \"" << nombre << "\", \"run_type\": \"iteration\", "
+          << "\"iterations\": " << r.iteraciones << ", \"real_time\": " << r.mediaMs
+          << ", \"cpu_time\": " << r.cpuMs << ", \"time_unit\": \"ms\", \"median_ms\": " << r.medianaMs
+          << ", \"stddev_ms\": " << r.desvMs << ", \"min_ms\": " << r.minMs << "}";
+    }
+    f << "\n  ]\n}\n";
+    return (bool)f;
+}
+
+int main(int argc, char** argv) {
+    // 1. Argumentos
+    string carpeta = CARPETA_POR_DEFECTO, filtro, rutaJSON = "benchmark_resultados.json", rutaModelo = "dncnn.onnx";
+    double minSegundos = 0.5;
+    int maxCortes = 16;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--filtro" && i + 1 < argc) filtro = argv[++i];
+        else if (arg == "--json" && i + 1 < argc) rutaJSON = argv[++i];
+        else if (arg == "--min-tiempo" && i + 1 < argc) minSegundos = atof(argv[++i]);
+        else if (arg == "--cortes" && i + 1 < argc) maxCortes = max(1, atoi(argv[++i]));
+        else if (arg == "--modelo" && i + 1 < argc) rutaModelo = argv[++i];
+        else if (arg.compare(0, 2, "--") != 0) carpeta = arg;
+        else { cout << "ERROR: Argumento desconocido '" << arg << "'." << endl; return -1; }
+    }
+
+    // 2. Cortes reales del dataset
+    vector<string> archivos = DicomHandler::buscarArchivos(carpeta);
+    if (archivos.empty()) {
+        cout << "ERROR: No se encontraron imagenes medicas en '" << carpeta << "'." << endl;
+        return -1;
+    }
+    if ((int)archivos.size() > maxCortes) archivos.resize(maxCortes);
+
+    DicomHandler dicomIO;
+    ImageProcessor proc;
+    vector<cv::Mat> cortes;
+    for (const string& a : archivos) {
+        cv::Mat hu = dicomIO.cargarImagenDicom(a);
+        if (!hu.empty()) cortes.push_back(hu.clone());
+    }
+    if (cortes.empty()) {
+        cout << "ERROR: No se pudo decodificar ningun corte." << endl;
+        return -1;
+    }
+    proc.cargarRedNeuronal(rutaModelo);
+
+    // 3. Tamaños y número de hilos a barrer
+    const int tamanos[] = {256, 512, 1024};
+    const int hilosMax = max(1, cv::getNumThreads());
+    vector<int> hilos = {1};
+    for (int h = 2; h < hilosMax; h *= 2) hilos.push_back(h);
+    if (hilosMax > 1) hilos.push_back(hilosMax);
+
+    vector<Entradas> entradas;
+    for (int tam : tamanos) {
+        Entradas e;
+        e.tam = tam;
+        for (const cv::Mat& c : cortes) {
+            cv::Mat hu;
+            cv::resize(c, hu, cv::Size(tam, tam), 0, 0, cv::INTER_LINEAR);
+            e.hu.push_back(hu);
+            e.ventana.push_back(proc.aplicarContrastStretching(hu));
+            e.mascara.push_back(proc.segmentarHueso(hu));
+        }
+        entradas.push_back(e);
+    }
+
+    // 4. Catálogo de benchmarks. Las salidas se declaran fuera del bucle (como haría el
+    // visor) para medir el régimen estable con la API de parámetros de salida.
+    vector<Benchmark> catalogo;
+    catalogo.push_back({"BM_cargarImagenDicom", false, [&](Estado& st, const Entradas&) {
+        while (st.seguir()) {
+            cv::Mat hu = dicomIO.cargarImagenDicom(archivos[st.indice() % archivos.size()]);
+            if (hu.empty()) st.omitir("fallo de lectura");
+        }
+    }});
+    catalogo.push_back({"BM_aplicarContrastStretching", true, [&](Estado& st, const Entradas& e) {
+        cv::Mat salida;
+        while (st.seguir()) proc.aplicarContrastStretching(e.hu[st.indice() % e.hu.size()], salida);
+    }});
+    catalogo.push_back({"BM_mejorarContraste", true, [&](Estado& st, const Entradas& e) {
+        cv::Mat salida;
+        while (st.seguir()) proc.mejorarContraste(e.ventana[st.indice() % e.ventana.size()], true, salida);
+    }});
+    for (int preset = 0; preset < NUM_PRESETS_RUIDO; preset++) {
+        string nombre = string("BM_aplicarReduccionRuido_") + ImageProcessor::nombrePresetRuido(preset);
+        replace(nombre.begin(), nombre.end(), ' ', '_');
+        replace(nombre.begin(), nombre.end(), '-', '_');
+        catalogo.push_back({nombre, true, [&, preset](Estado& st, const Entradas& e) {
+            // Sin modelo (o si no acepta las teselas) el preset DnCNN mediría el respaldo NL-Means
+            if (preset == RUIDO_DNN) {
+                proc.aplicarReduccionRuido(e.ventana[0], true, RUIDO_DNN);
+                if (!proc.redDisponible()) {
+                    st.omitir("sin modelo DnCNN");
+                    return;
+                }
+            }
+            cv::Mat salida;
+            while (st.seguir()) proc.aplicarReduccionRuido(e.ventana[st.indice() % e.ventana.size()], true, preset, salida);
+        }});
+    }
+    catalogo.push_back({"BM_segmentarHueso", true, [&](Estado& st, const Entradas& e) {
+        cv::Mat mascara;
+        while (st.seguir()) proc.segmentarHueso(e.hu[st.indice() % e.hu.size()], mascara);
+    }});
+    catalogo.push_back({"BM_segmentarPulmon", true, [&](Estado& st, const Entradas& e) {
+        cv::Mat mascara;
+        while (st.seguir()) proc.segmentarPulmon(e.hu[st.indice() % e.hu.size()], mascara);
+    }});
+    catalogo.push_back({"BM_segmentarTejidoBlando", true, [&](Estado& st, const Entradas& e) {
+        cv::Mat mascara;
+        while (st.seguir()) proc.segmentarTejidoBlando(e.hu[st.indice() % e.hu.size()], mascara);
+    }});
+    catalogo.push_back({"BM_crearOverlay", true, [&](Estado& st, const Entradas& e) {
+        cv::Mat final;
+        while (st.seguir()) {
+            size_t k = st.indice() % e.ventana.size();
+            proc.crearOverlay(e.ventana[k], e.mascara[k], proc.colorModo(1), final);
+        }
+    }});
+    catalogo.push_back({"BM_segmentarYSuperponer", true, [&](Estado& st, const Entradas& e) {
+        ConfiguracionPipeline config;
+        config.modo = 1;
+        cv::Mat mascara, final;
+        while (st.seguir()) {
+            size_t k = st.indice() % e.hu.size();
+            proc.segmentarYSuperponer(e.hu[k], e.ventana[k], config, cv::Mat(), mascara, final);
+        }
+    }});
+    catalogo.push_back({"BM_extraerContornos", true, [&](Estado& st, const Entradas& e) {
+        ContourExtractor extractor;
+        ContornosCorte contornos;
+        while (st.seguir()) extractor.extraer(e.mascara[st.indice() % e.mascara.size()], contornos);
+    }});
+    // Almacén comprimido: la descompresión es lo que paga el visor al cambiar de corte
+    catalogo.push_back({"BM_descomprimirCorte", true, [&](Estado& st, const Entradas& e) {
+        vector<vector<uint8_t>> comprimidos(e.hu.size());
+        for (size_t k = 0; k < e.hu.size(); k++) SliceStore::comprimirHU(e.hu[k], comprimidos[k]);
+        cv::Mat hu;
+        while (st.seguir()) {
+            size_t k = st.indice() % comprimidos.size();
+            SliceStore::descomprimirHU(comprimidos[k], e.tam, e.tam, hu);
+        }
+    }});
+    catalogo.push_back({"BM_descomprimirMascara", true, [&](Estado& st, const Entradas& e) {
+        vector<vector<uint8_t>> comprimidas(e.mascara.size());
+        for (size_t k = 0; k < e.mascara.size(); k++) SliceStore::comprimirMascara(e.mascara[k], comprimidas[k]);
+        cv::Mat mascara;
+        while (st.seguir()) {
+            size_t k = st.indice() % comprimidas.size();
+            SliceStore::descomprimirMascara(comprimidas[k], e.tam, e.tam, mascara);
+        }
+    }});
+    catalogo.push_back({"BM_guardarResultados", true, [&](Estado& st, const Entradas& e) {
+        cv::Mat final;
+        proc.crearOverlay(e.ventana[0], e.mascara[0], proc.colorModo(1), final);
+        string nombre = "bench_" + to_string(e.tam) + ".IMA";
+        // guardarResultados informa cada guardado por consola: se silencia durante la medición
+        ostringstream silencio;
+        streambuf* consola = cout.rdbuf(silencio.rdbuf());
+        while (st.seguir()) {
+            size_t k = st.indice() % e.ventana.size();
+            proc.guardarResultados(nombre, e.ventana[k], e.ventana[k], e.mascara[k], final);
+        }
+        cout.rdbuf(consola);
+    }});
+
+    // 5. Ejecutar: cada benchmark x tamaño x hilos
+    cout << "[BENCH] " << cortes.size() << " cortes de " << carpeta << endl;
+    cout << left << setw(56) << "Benchmark" << right << setw(12) << "Tiempo ms" << setw(12) << "CPU ms"
+         << setw(12) << "Iteraciones" << endl;
+    cout << string(92, '-') << endl;
+
+    vector<Resultado> resultados;
+    for (const Benchmark& b : catalogo) {
+        size_t numTamanos = b.dependeDelTamano ? entradas.size() : 1;
+        for (size_t t = 0; t < numTamanos; t++) {
+            for (int h : hilos) {
+                string nombre = b.nombre;
+                if (b.dependeDelTamano) nombre += "/" + to_string(entradas[t].tam);
+                nombre += "/hilos:" + to_string(h);
+                if (!filtro.empty() && nombre.find(filtro) == string::npos) continue;
+
+                cv::setNumThreads(h);
+                Estado st(minSegundos, 1000000);
+                b.cuerpo(st, entradas[b.dependeDelTamano ? t : 1]);
+                if (!st.motivoOmision.empty()) {
+                    cout << left << setw(56) << nombre << "  OMITIDO (" << st.motivoOmision << ")" << endl;
+                    continue;
+                }
+                Resultado r = resumir(nombre, st);
+                resultados.push_back(r);
+                cout << left << setw(56) << nombre << right << fixed << setprecision(3)
+                     << setw(12) << r.mediaMs << setw(12) << r.cpuMs << setw(12) << r.iteraciones << endl;
+            }
+        }
+    }
+    cv::setNumThreads(hilosMax);
+
+    // 6. Resultados legibles por máquina
+    if (exportarJSON(rutaJSON, resultados, carpeta)) {
+        cout << "[BENCH] Resultados guardados en " << rutaJSON << endl;
+    } else {
+        cout << "[AVISO] No se pudo escribir " << rutaJSON << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "ContourExtractor.h"
+#include "Profiler.h"
+#include "ResultExporter.h"
+#include <algorithm>
+#include <fstream>
+
+ContourExtractor::ContourExtractor(double toleranciaPx, double areaMinimaPx)
+    : tolerancia(toleranciaPx), areaMinima(areaMinimaPx) {}
+
+ContornosCorte ContourExtractor::extraer(const cv::Mat& mascara) const {
+    ContornosCorte salida;
+    extraer(mascara, salida);
+    return salida;
+}
+
+void ContourExtractor::extraer(const cv::Mat& mascara, ContornosCorte& salida) const {
+    TemporizadorEtapa tiempo(PERF_CONTORNOS);
+    salida.clear();
+    if (mascara.empty()) return;
+
+    // 1. Contornos en dos niveles: jerarquia[i] = {siguiente, anterior, primer hijo, padre}
+    std::vector<std::vector<cv::Point>> contornos;
+    std::vector<cv::Vec4i> jerarquia;
+    cv::findContours(mascara, contornos, jerarquia, cv::RETR_CCOMP, cv::CHAIN_APPROX_SIMPLE);
+
+    // 2. Exteriores con sus agujeros a continuación; los índices de 'padre' se renumeran
+    // porque los contornos pequeños se descartan
+    for (size_t i = 0; i < contornos.size(); i++) {
+        if (jerarquia[i][3] >= 0) continue;   // Agujero: va con su exterior
+        if (cv::contourArea(contornos[i]) < areaMinima) continue;
+
+        int exterior = (int)salida.size();
+        salida.emplace_back();
+        cv::approxPolyDP(contornos[i], salida.back().puntos, tolerancia, true);
+
+        for (int h = jerarquia[i][2]; h >= 0; h = jerarquia[h][0]) {
+            if (cv::contourArea(contornos[h]) < areaMinima) continue;
+            PoligonoROI agujero;
+            cv::approxPolyDP(contornos[h], agujero.puntos, tolerancia, true);
+            agujero.padre = exterior;
+            salida.push_back(std::move(agujero));
+        }
+    }
+}
+
+void ContourExtractor::dibujar(cv::Mat& imagen, const ContornosCorte& contornos, const cv::Scalar& color, int grosor) {
+    for (const PoligonoROI& p : contornos) cv::polylines(imagen, p.puntos, true, color, grosor, cv::LINE_8);
+}
+
+size_t ContourExtractor::numPuntos(const ContornosCorte& contornos) {
+    size_t total = 0;
+    for (const PoligonoROI& p : contornos) total += p.puntos.size();
+    return total;
+}
+
+namespace {
+
+void escribirCabecera(std::ostream& f, size_t numCortes, const double espaciado[3], const std::string& etiqueta) {
+    f << "{\n  \"mascara\": \"" << ResultExporter::escaparJSON(etiqueta) << "\", \"cortes\": " << numCortes << ",\n"
+      << "  \"unidades\": \"pixel\", \"espaciado_mm\": [" << espaciado[0] << ", " << espaciado[1] << ", "
+      << espaciado[2] << "],\n  \"por_corte\": [";
+}
+
+void escribirCorte(std::ostream& f, size_t z, const std::string& ruta, const ContornosCorte& contornos) {
+    std::string archivo = ruta.substr(ruta.find_last_of("/\\") + 1);
+    f << "    {\"corte\": " << z << ", \"archivo\": \"" << ResultExporter::escaparJSON(archivo) << "\", \"contornos\": [";
+    for (size_t c = 0; c < contornos.size(); c++) {
+        const PoligonoROI& p = contornos[c];
+        f << (c ? ",\n" : "\n") << "      {\"padre\": " << p.padre << ", \"puntos\": [";
+        for (size_t k = 0; k < p.puntos.size(); k++) {
+            f << (k ? "," : "") << p.puntos[k].x << "," << p.puntos[k].y;
+        }
+        f << "]}";
+    }
+    f << "\n    ]}";
+}
+
+} // namespace
+
+bool ContourExtractor::exportarJSON(const std::string& ruta, const std::vector<ContornosCorte>& cortes,
+                                    const std::vector<std::string>& archivos, const double espaciado[3],
+                                    const std::string& etiqueta) {
+    std::ofstream f(ruta);
+    if (!f) return false;
+    escribirCabecera(f, cortes.size(), espaciado, etiqueta);
+    bool primero = true;
+    for (size_t z = 0; z < cortes.size(); z++) {
+        if (cortes[z].empty()) continue;
+        f << (primero ? "\n" : ",\n");
+        escribirCorte(f, z, z < archivos.size() ? archivos[z] : "", cortes[z]);
+        primero = false;
+    }
+    f << "\n  ]\n}\n";
+    return (bool)f;
+}
+
+bool ContourExtractor::exportarJSON(const std::string& ruta, const ContornosCorte& contornos, int indice,
+                                    const std::string& archivo, const double espaciado[3],
+                                    const std::string& etiqueta) {
+    std::ofstream f(ruta);
+    if (!f) return false;
+    escribirCabecera(f, 1, espaciado, etiqueta);
+    f << "\n";
+    escribirCorte(f, std::max(indice, 0), archivo, contornos);
+    f << "\n  ]\n}\n";
+    return (bool)f;
+}
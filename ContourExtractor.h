@@ -0,0 +1,51 @@
+#ifndef CONTOUREXTRACTOR_H
+#define CONTOUREXTRACTOR_H
+
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Contorno simplificado de una región de la máscara (coordenadas en píxeles del corte)
+struct PoligonoROI {
+    std::vector<cv::Point> puntos;
+    int padre = -1;   // Agujero: índice de su contorno exterior. Exterior: -1
+
+    bool agujero() const { return padre >= 0; }
+};
+using ContornosCorte = std::vector<PoligonoROI>;
+
+// Contornos vectoriales de las máscaras: exteriores y agujeros (dos niveles, RETR_CCOMP),
+// simplificados con Douglas-Peucker. Un corte de 512x512 se queda en unos cientos de
+// puntos: el overlay de VER BORDES se dibuja con ellos y la exportación vectorial ocupa
+// una fracción de las cuatro imágenes por corte.
+// Sin estado mutable: un mismo extractor se puede usar desde varios hilos.
+class ContourExtractor {
+public:
+    // 'toleranciaPx': distancia máxima del polígono al borde real.
+    // 'areaMinimaPx': los contornos más pequeños (ruido de un píxel) se descartan con sus agujeros.
+    explicit ContourExtractor(double toleranciaPx = 0.75, double areaMinimaPx = 4.0);
+
+    ContornosCorte extraer(const cv::Mat& mascara) const;
+    void extraer(const cv::Mat& mascara, ContornosCorte& salida) const;
+
+    // Dibuja los contornos (cerrados) sobre una imagen BGR
+    static void dibujar(cv::Mat& imagen, const ContornosCorte& contornos, const cv::Scalar& color, int grosor = 1);
+    static size_t numPuntos(const ContornosCorte& contornos);
+
+    // Exportación de una serie (o de un corte): por corte con contornos, cada polígono como
+    // lista plana x0,y0,x1,y1,... en píxeles (como ContourData de DICOM-RT), con el espaciado
+    // en mm para pasar a coordenadas físicas. 'archivos' (opcional) da nombre a cada corte.
+    static bool exportarJSON(const std::string& ruta, const std::vector<ContornosCorte>& cortes,
+                             const std::vector<std::string>& archivos, const double espaciado[3],
+                             const std::string& etiqueta);
+    // Un único corte (botón GUARDAR del visor): "cortes": 1 con su índice real en la serie
+    static bool exportarJSON(const std::string& ruta, const ContornosCorte& contornos, int indice,
+                             const std::string& archivo, const double espaciado[3],
+                             const std::string& etiqueta);
+
+private:
+    double tolerancia;
+    double areaMinima;
+};
+
+#endif
@@ -1,13 +1,38 @@
 #include "DicomHandler.h"
-#include <itkRescaleIntensityImageFilter.h>
-#include <itkCastImageFilter.h>
+#include "ItkMatBridge.h"
+#include "Profiler.h"
+#include "VolumeCache.h"
+#include <itkGDCMImageIO.h>
+#include <itkGDCMSeriesFileNames.h>
+#include <gdcmScanner.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <dirent.h>
+#include <sys/stat.h>
 
-DicomHandler::DicomHandler() {}
+DicomHandler::DicomHandler() {
+    // El primer New() de ITK registra las fábricas de objetos: se hace una sola vez,
+    // antes de que varios hilos (o varios estudios) decodifiquen en paralelo
+    static std::once_flag registroITK;
+    std::call_once(registroITK, [] { itk::GDCMImageIO::New(); });
+}
 
-cv::Mat DicomHandler::cargarImagenDicom(const std::string& rutaArchivo) {
-    // 1. Configurar el lector ITK
+cv::Mat DicomHandler::cargarImagenDicom(const std::string& rutaArchivo, MetadatosCorte* metadatos) {
+    TemporizadorEtapa tiempo(PERF_DECODIFICAR);
+    // 1. Configurar el lector ITK con GDCM explícito para acceder al encabezado
     using ReaderType = itk::ImageFileReader<ImageType>;
+    using ImageIOType = itk::GDCMImageIO;
+    ImageIOType::Pointer dicomIO = ImageIOType::New();
     ReaderType::Pointer reader = ReaderType::New();
+    reader->SetImageIO(dicomIO);
     reader->SetFileName(rutaArchivo);
 
     try {
@@ -17,27 +42,325 @@ cv::Mat DicomHandler::cargarImagenDicom(const std::string& rutaArchivo) {
         return cv::Mat();
     }
 
-    // 2. Los datos médicos tienen rangos raros (ej. -1000 a 3000).
-    // Debemos escalarlos a 0-255 para que OpenCV los pueda mostrar.
-    using OutputPixelType = unsigned char;
-    using OutputImageType = itk::Image<OutputPixelType, 2>;
-    
-    using RescaleFilterType = itk::RescaleIntensityImageFilter<ImageType, OutputImageType>;
-    RescaleFilterType::Pointer rescaler = RescaleFilterType::New();
-    rescaler->SetInput(reader->GetOutput());
-    rescaler->SetOutputMinimum(0);
-    rescaler->SetOutputMaximum(255);
-    rescaler->Update();
-
-    // 3. Convertir de ITK SmartPointer a cv::Mat
-    OutputImageType::Pointer itkImg = rescaler->GetOutput();
-    OutputImageType::SizeType size = itkImg->GetLargestPossibleRegion().GetSize();
-    
-    // Crear matriz de OpenCV con el mismo tamaño
-    cv::Mat opencvImg(size[1], size[0], CV_8UC1);
-
-    // Copiar memoria buffer de ITK a OpenCV
-    std::memcpy(opencvImg.data, itkImg->GetBufferPointer(), size[0] * size[1]);
-
-    return opencvImg.clone(); // Devolver copia segura
-}
\ No newline at end of file
+    // 2. GDCMImageIO ya aplica Rescale Slope/Intercept al leer, así que los valores
+    // signed short que entrega son directamente Unidades Hounsfield (ej. -1024 a 3071).
+    // No reescalamos a 0-255 aquí: el paso a 8 bits se hace solo al visualizar.
+    ImageType::Pointer itkImg = reader->GetOutput();
+
+    if (metadatos) {
+        metadatos->pendiente = dicomIO->GetRescaleSlope();
+        metadatos->intercepto = dicomIO->GetRescaleIntercept();
+        metadatos->espaciadoX = itkImg->GetSpacing()[0];
+        metadatos->espaciadoY = itkImg->GetSpacing()[1];
+    }
+
+    // 3. Convertir de ITK SmartPointer a cv::Mat sin copiar: la Mat apunta al
+    // buffer de ITK y mantiene viva la imagen mientras se use
+    return envolverImagenITK<ImageType>(itkImg, CV_16SC1);
+}
+
+bool DicomHandler::cargarVolumenDicom(const std::string& carpeta, VolumenCT& volumen, VolumeCache* cache) {
+    TemporizadorEtapa tiempo(PERF_VOLUMEN);
+    // La huella solo mira el sistema de archivos (stat), no los encabezados DICOM
+    std::vector<std::string> fuentes;
+    if (cache) fuentes = buscarArchivos(carpeta);
+    return cargarConCache(fuentes, volumen, cache, [&](VolumenCT& v) { return decodificarVolumen(carpeta, v); });
+}
+
+bool DicomHandler::cargarSerieDicom(const SerieDicom& serie, VolumenCT& volumen, VolumeCache* cache) {
+    TemporizadorEtapa tiempo(PERF_VOLUMEN);
+    return cargarConCache(serie.archivos, volumen, cache,
+                          [&](VolumenCT& v) { return decodificarArchivos(serie.archivos, v); });
+}
+
+bool DicomHandler::cargarConCache(const std::vector<std::string>& fuentes, VolumenCT& volumen, VolumeCache* cache,
+                                  const std::function<bool(VolumenCT&)>& decodificar) {
+    // 1. Caché al día: el volumen se mapea tal cual, sin pasar por ITK
+    uint64_t huella = 0;
+    if (fuentes.empty()) cache = nullptr;   // Sin archivos fuente no se puede validar la caché
+    if (cache) huella = VolumeCache::calcularHuella(fuentes);
+    if (cache && cache->abrir(huella, volumen)) {
+        std::cout << "[CACHE] Volumen mapeado desde " << cache->ruta() << std::endl;
+        return true;
+    }
+
+    // 2. Decodificación normal y, si hay caché, se regenera y se vuelve a abrir
+    // mapeada (así las capas de ruido se pueden ir guardando durante la sesión)
+    if (!decodificar(volumen)) return false;
+    if (cache && cache->crear(volumen, huella)) {
+        VolumenCT mapeado;
+        if (cache->abrir(huella, mapeado)) volumen = mapeado;
+    }
+    return true;
+}
+
+bool DicomHandler::decodificarVolumen(const std::string& carpeta, VolumenCT& volumen) {
+    // Agrupar por serie y ordenar los archivos por posición del paciente
+    std::vector<std::string> archivos;
+    try {
+        using NamesGeneratorType = itk::GDCMSeriesFileNames;
+        NamesGeneratorType::Pointer nombres = NamesGeneratorType::New();
+        nombres->SetUseSeriesDetails(true);
+        nombres->SetDirectory(carpeta);
+
+        // Si hay varias series en la carpeta, nos quedamos con la más larga
+        for (const std::string& uid : nombres->GetSeriesUIDs()) {
+            std::vector<std::string> serie = nombres->GetFileNames(uid);
+            if (serie.size() > archivos.size()) archivos = serie;
+        }
+    } catch (itk::ExceptionObject& err) {
+        std::cerr << "Error ordenando serie DICOM: " << err << std::endl;
+        return false;
+    }
+    return decodificarArchivos(archivos, volumen);
+}
+
+bool DicomHandler::decodificarArchivos(const std::vector<std::string>& archivos, VolumenCT& volumen) {
+    using ImageIOType = itk::GDCMImageIO;
+    volumen = VolumenCT();
+    if (archivos.empty()) return false;
+
+    // 1. Geometría: se analiza una sola vez, con el primer corte
+    ImageIOType::Pointer info = ImageIOType::New();
+    try {
+        info->SetFileName(archivos[0]);
+        info->ReadImageInformation();
+    } catch (itk::ExceptionObject& err) {
+        std::cerr << "Error leyendo DICOM: " << err << std::endl;
+        return false;
+    }
+    volumen.ancho = (int)info->GetDimensions(0);
+    volumen.alto = (int)info->GetDimensions(1);
+    volumen.numCortes = (int)archivos.size();
+    volumen.espaciado[0] = info->GetSpacing(0);
+    volumen.espaciado[1] = info->GetSpacing(1);
+    volumen.metadatos.pendiente = info->GetRescaleSlope();
+    volumen.metadatos.intercepto = info->GetRescaleIntercept();
+    volumen.metadatos.espaciadoX = volumen.espaciado[0];
+    volumen.metadatos.espaciadoY = volumen.espaciado[1];
+
+    // El espaciado entre cortes sale de la distancia entre las posiciones de los dos primeros
+    volumen.espaciado[2] = info->GetSpacing(2);
+    if (archivos.size() > 1) {
+        ImageIOType::Pointer info2 = ImageIOType::New();
+        try {
+            info2->SetFileName(archivos[1]);
+            info2->ReadImageInformation();
+            double d = 0;
+            for (int k = 0; k < 3; k++) {
+                double dk = info2->GetOrigin(k) - info->GetOrigin(k);
+                d += dk * dk;
+            }
+            if (d > 0) volumen.espaciado[2] = std::sqrt(d);
+        } catch (itk::ExceptionObject&) {
+            // Nos quedamos con el espaciado del encabezado
+        }
+    }
+
+    // 2. Un único buffer contiguo para toda la serie
+    volumen.datos.create(volumen.numCortes * volumen.alto, volumen.ancho, CV_16SC1);
+    volumen.archivos = archivos;
+
+    // 3. Lectura en paralelo: cada archivo se decodifica directamente en su tramo
+    // del buffer. Si el tipo de píxel del archivo no es signed short (o la
+    // geometría no coincide), se usa el lector normal y se copia el corte.
+    std::atomic<int> fallidos(0);
+    cv::parallel_for_(cv::Range(0, volumen.numCortes), [&](const cv::Range& rango) {
+        for (int z = rango.start; z < rango.end; z++) {
+            cv::Mat destino = volumen.corte(z);
+            try {
+                ImageIOType::Pointer io = ImageIOType::New();
+                io->SetFileName(archivos[z]);
+                io->ReadImageInformation();
+                bool directo = io->GetComponentType() == itk::IOComponentEnum::SHORT
+                            && io->GetNumberOfComponents() == 1
+                            && (int)io->GetDimensions(0) == volumen.ancho
+                            && (int)io->GetDimensions(1) == volumen.alto;
+                if (directo) {
+                    io->Read(destino.data);
+                    continue;
+                }
+            } catch (itk::ExceptionObject&) {
+                // Se reintenta con el lector normal
+            }
+
+            cv::Mat img = cargarImagenDicom(archivos[z]);
+            if (img.size() == destino.size()) img.copyTo(destino);
+            else { destino.setTo(cv::Scalar(-1024)); fallidos++; }   // Corte perdido: aire
+        }
+    });
+
+    if (fallidos > 0) {
+        std::cerr << "[AVISO] " << fallidos.load() << " cortes no se pudieron leer en el volumen." << std::endl;
+    }
+    return true;
+}
+
+std::vector<std::string> DicomHandler::buscarArchivos(const std::string& carpeta) {
+    std::vector<std::string> archivos;
+    cv::glob(carpeta + "/*.IMA", archivos, false);
+    if (archivos.empty()) cv::glob(carpeta + "/*.dcm", archivos, false);
+    return archivos;
+}
+
+// --- DESCUBRIMIENTO DE SERIES (ÁRBOLES DE CARPETAS) ---
+namespace {
+
+// Extensiones habituales de DICOM; los archivos sin extensión también se prueban
+bool esCandidatoDicom(const std::string& nombre) {
+    if (nombre.empty() || nombre[0] == '.' || nombre == "DICOMDIR") return false;
+    size_t punto = nombre.find_last_of('.');
+    if (punto == std::string::npos) return true;
+    std::string ext = nombre.substr(punto + 1);
+    for (char& c : ext) c = (char)std::tolower((unsigned char)c);
+    return ext == "ima" || ext == "dcm" || ext == "dicom";
+}
+
+// Lista los candidatos de una carpeta y sus subcarpetas (orden alfabético, determinista)
+void listarCarpeta(const std::string& carpeta, std::vector<std::string>& archivos,
+                   std::vector<std::string>& subcarpetas) {
+    DIR* dir = opendir(carpeta.c_str());
+    if (!dir) return;
+    while (dirent* e = readdir(dir)) {
+        std::string nombre = e->d_name;
+        if (nombre == "." || nombre == ".." || nombre[0] == '.') continue;
+        std::string ruta = carpeta + "/" + nombre;
+        struct stat st;
+        if (stat(ruta.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) subcarpetas.push_back(ruta);
+        else if (S_ISREG(st.st_mode) && esCandidatoDicom(nombre)) archivos.push_back(ruta);
+    }
+    closedir(dir);
+    std::sort(archivos.begin(), archivos.end());
+    std::sort(subcarpetas.begin(), subcarpetas.end());
+}
+
+std::string recortar(const char* v) {
+    if (!v) return std::string();
+    std::string s(v);
+    size_t fin = s.find_last_not_of(" \t\r\n");
+    return fin == std::string::npos ? std::string() : s.substr(0, fin + 1);
+}
+
+// Corte leído del encabezado, antes de agruparlo en su serie
+struct CorteEscaneado {
+    std::string ruta;
+    double posicion[3] = {0, 0, 0};
+    double orientacion[6] = {1, 0, 0, 0, 1, 0};
+    bool tienePosicion = false;
+    int instancia = 0;
+};
+
+} // namespace
+
+std::vector<SerieDicom> DicomHandler::descubrirSeries(const std::string& raiz, bool recursivo) {
+    const gdcm::Tag tagSerie(0x0020, 0x000e), tagDescripcion(0x0008, 0x103e), tagPaciente(0x0010, 0x0020),
+                    tagFilas(0x0028, 0x0010), tagColumnas(0x0028, 0x0011), tagInstancia(0x0020, 0x0013),
+                    tagPosicion(0x0020, 0x0032), tagOrientacion(0x0020, 0x0037), tagEspaciado(0x0028, 0x0030);
+
+    std::vector<SerieDicom> series;
+    std::map<std::string, size_t> indicePorUid;
+    std::vector<std::vector<CorteEscaneado>> cortes;   // Paralelo a 'series'
+    size_t escaneados = 0;
+    int64 t0 = cv::getTickCount();
+
+    // 1. Recorrido en profundidad con una pila explícita (sin recursión)
+    std::vector<std::string> pendientes(1, raiz);
+    while (!pendientes.empty()) {
+        std::string carpeta = pendientes.back();
+        pendientes.pop_back();
+        std::vector<std::string> archivos, subcarpetas;
+        listarCarpeta(carpeta, archivos, subcarpetas);
+        if (recursivo) {
+            // Al revés para que la pila las visite en orden alfabético
+            for (auto it = subcarpetas.rbegin(); it != subcarpetas.rend(); ++it) pendientes.push_back(*it);
+        }
+        if (archivos.empty()) continue;
+
+        // 2. Escaneo de encabezados: gdcm::Scanner deja de leer en la última etiqueta pedida
+        gdcm::Scanner escaner;
+        for (const gdcm::Tag& t : {tagSerie, tagDescripcion, tagPaciente, tagFilas, tagColumnas,
+                                   tagInstancia, tagPosicion, tagOrientacion, tagEspaciado}) {
+            escaner.AddTag(t);
+        }
+        if (!escaner.Scan(archivos)) continue;
+
+        std::set<std::string> uidsCarpeta;
+        for (const std::string& ruta : archivos) {
+            if (!escaner.IsKey(ruta.c_str())) continue;   // No es DICOM
+            std::string uid = recortar(escaner.GetValue(ruta.c_str(), tagSerie));
+            if (uid.empty()) continue;
+            escaneados++;
+
+            auto it = indicePorUid.find(uid);
+            if (it == indicePorUid.end()) {
+                SerieDicom nueva;
+                nueva.uid = uid;
+                nueva.descripcion = recortar(escaner.GetValue(ruta.c_str(), tagDescripcion));
+                nueva.paciente = recortar(escaner.GetValue(ruta.c_str(), tagPaciente));
+                nueva.directorio = carpeta;
+                nueva.alto = std::atoi(recortar(escaner.GetValue(ruta.c_str(), tagFilas)).c_str());
+                nueva.ancho = std::atoi(recortar(escaner.GetValue(ruta.c_str(), tagColumnas)).c_str());
+                // Pixel Spacing va en orden fila, columna: primero el espaciado en y
+                double ey = 0, ex = 0;
+                std::string esp = recortar(escaner.GetValue(ruta.c_str(), tagEspaciado));
+                if (std::sscanf(esp.c_str(), "%lf\\%lf", &ey, &ex) == 2 && ex > 0 && ey > 0) {
+                    nueva.espaciado[0] = ex;
+                    nueva.espaciado[1] = ey;
+                }
+                it = indicePorUid.insert(std::make_pair(uid, series.size())).first;
+                series.push_back(nueva);
+                cortes.emplace_back();
+            }
+            uidsCarpeta.insert(uid);
+
+            CorteEscaneado c;
+            c.ruta = ruta;
+            c.instancia = std::atoi(recortar(escaner.GetValue(ruta.c_str(), tagInstancia)).c_str());
+            std::string pos = recortar(escaner.GetValue(ruta.c_str(), tagPosicion));
+            c.tienePosicion = std::sscanf(pos.c_str(), "%lf\\%lf\\%lf",
+                                          &c.posicion[0], &c.posicion[1], &c.posicion[2]) == 3;
+            std::string ori = recortar(escaner.GetValue(ruta.c_str(), tagOrientacion));
+            std::sscanf(ori.c_str(), "%lf\\%lf\\%lf\\%lf\\%lf\\%lf", &c.orientacion[0], &c.orientacion[1],
+                        &c.orientacion[2], &c.orientacion[3], &c.orientacion[4], &c.orientacion[5]);
+            cortes[it->second].push_back(c);
+        }
+        if (uidsCarpeta.size() > 1) {
+            for (const std::string& uid : uidsCarpeta) series[indicePorUid[uid]].unicaEnDirectorio = false;
+        }
+    }
+
+    // 3. Orden dentro de cada serie: distancia a lo largo de la normal del corte
+    // (fila x columna de Image Orientation); sin posición, por Instance Number
+    for (size_t s = 0; s < series.size(); s++) {
+        std::vector<CorteEscaneado>& lista = cortes[s];
+        const double* o = lista[0].orientacion;
+        double normal[3] = {o[1] * o[5] - o[2] * o[4], o[2] * o[3] - o[0] * o[5], o[0] * o[4] - o[1] * o[3]};
+        bool porPosicion = true;
+        for (const CorteEscaneado& c : lista) porPosicion = porPosicion && c.tienePosicion;
+
+        std::vector<std::pair<double, size_t>> claves(lista.size());
+        for (size_t k = 0; k < lista.size(); k++) {
+            const double* p = lista[k].posicion;
+            double d = porPosicion ? p[0] * normal[0] + p[1] * normal[1] + p[2] * normal[2]
+                                   : (double)lista[k].instancia;
+            claves[k] = std::make_pair(d, k);
+        }
+        std::stable_sort(claves.begin(), claves.end(),
+                         [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+                             return a.first < b.first;
+                         });
+        series[s].archivos.reserve(lista.size());
+        for (const auto& c : claves) series[s].archivos.push_back(lista[c.second].ruta);
+        // Espaciado en z: distancia media entre cortes consecutivos
+        if (porPosicion && claves.size() > 1 && claves.back().first > claves.front().first) {
+            series[s].espaciado[2] = (claves.back().first - claves.front().first) / (claves.size() - 1);
+        }
+        // Las rutas ya están en la serie: los datos del escaneo no se acumulan hasta el final
+        std::vector<CorteEscaneado>().swap(lista);
+    }
+
+    std::cout << "[SERIES] " << series.size() << " series en " << escaneados << " archivos ("
+              << (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency() << " ms)." << std::endl;
+    return series;
+}
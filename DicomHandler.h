@@ -1,20 +1,95 @@
 #ifndef DICOMHANDLER_H
 #define DICOMHANDLER_H
 
+#include <functional>
 #include <string>
+#include <vector>
 #include <opencv2/opencv.hpp>
 #include <itkImage.h>
 #include <itkImageFileReader.h>
 
+class VolumeCache;
+
 // Definimos el tipo de imagen médica (2 dimensiones, pixeles short con signo)
 using PixelType = signed short;
 using ImageType = itk::Image<PixelType, 2>;
 
+// Datos del encabezado DICOM necesarios para interpretar los píxeles
+struct MetadatosCorte {
+    double pendiente = 1.0;    // Rescale Slope (0028,1053)
+    double intercepto = 0.0;   // Rescale Intercept (0028,1052)
+    double espaciadoX = 1.0;   // mm por píxel (columnas)
+    double espaciadoY = 1.0;   // mm por píxel (filas)
+};
+
+// Serie completa en un único buffer contiguo (CV_16S, HU), ordenada por la posición
+// del corte. Los cortes se apilan por filas: 'datos' mide (numCortes*alto) x ancho,
+// así cada corte es una vista barata (rowRange) que comparte el buffer.
+struct VolumenCT {
+    cv::Mat datos;
+    int numCortes = 0;
+    int alto = 0;
+    int ancho = 0;
+    double espaciado[3] = {1.0, 1.0, 1.0};   // mm en x, y, z
+    MetadatosCorte metadatos;
+    std::vector<std::string> archivos;       // Un archivo por corte, en el mismo orden
+
+    bool vacio() const { return datos.empty(); }
+    cv::Mat corte(int z) const { return datos.rowRange(z * alto, (z + 1) * alto); }
+};
+
+// Serie encontrada al recorrer un árbol de carpetas. Solo se leen unas pocas etiquetas
+// del encabezado de cada archivo (sin píxeles), así que el índice ocupa muy poco.
+struct SerieDicom {
+    std::string uid;                     // Series Instance UID (0020,000E)
+    std::string descripcion;             // Series Description (0008,103E)
+    std::string paciente;                // Patient ID (0010,0020)
+    std::string directorio;              // Carpeta del primer corte
+    bool unicaEnDirectorio = true;       // No comparte carpeta con otras series
+    int alto = 0;                        // Rows (0028,0010)
+    int ancho = 0;                       // Columns (0028,0011)
+    double espaciado[3] = {1.0, 1.0, 1.0};   // mm en x, y (0028,0030) y z (entre posiciones)
+    std::vector<std::string> archivos;   // Ordenados por posición a lo largo de la normal del corte
+
+    // Memoria del volumen decodificado (CV_16S)
+    size_t bytesVolumen() const { return archivos.size() * (size_t)alto * ancho * sizeof(PixelType); }
+};
+
+// Sin estado propio: cada llamada crea sus lectores ITK, así que una misma instancia
+// (o varias) se puede usar desde varios hilos a la vez
 class DicomHandler {
 public:
     DicomHandler();
-    // Función que recibe la ruta del archivo .IMA y devuelve una cv::Mat
-    cv::Mat cargarImagenDicom(const std::string& rutaArchivo);
+    // Función que recibe la ruta del archivo .IMA y devuelve una cv::Mat CV_16S
+    // en Unidades Hounsfield (ya aplicados Rescale Slope e Intercept)
+    cv::Mat cargarImagenDicom(const std::string& rutaArchivo, MetadatosCorte* metadatos = nullptr);
+
+    // Carga una carpeta como volumen 3D: orden por posición (GDCMSeriesFileNames),
+    // un solo análisis de la geometría y lectura de los archivos en paralelo.
+    // Con 'cache', si la caché binaria está al día se mapea sin decodificar nada;
+    // si no existe o los DICOM cambiaron, se decodifica y se escribe de nuevo.
+    bool cargarVolumenDicom(const std::string& carpeta, VolumenCT& volumen, VolumeCache* cache = nullptr);
+
+    // Igual que cargarVolumenDicom, para una serie ya descubierta (orden del escaneo)
+    bool cargarSerieDicom(const SerieDicom& serie, VolumenCT& volumen, VolumeCache* cache = nullptr);
+
+    // Lista los cortes de una carpeta (Soporta .IMA y .dcm)
+    static std::vector<std::string> buscarArchivos(const std::string& carpeta);
+
+    // Recorre 'raiz' (y sus subcarpetas si 'recursivo') y agrupa los archivos por Series
+    // Instance UID con un escaneo rápido de los encabezados (gdcm::Scanner, sin píxeles).
+    // Cada carpeta se escanea por separado (el gdcm::Scanner no acumula el árbol), pero el
+    // índice devuelto guarda la ruta de cada archivo: la memoria es O(archivos del árbol),
+    // unos 200 bytes por archivo durante el escaneo, y no cuenta en --memoria-mb.
+    static std::vector<SerieDicom> descubrirSeries(const std::string& raiz, bool recursivo = true);
+
+private:
+    // Mapea la caché si está al día con 'fuentes'; si no, decodifica y la regenera
+    bool cargarConCache(const std::vector<std::string>& fuentes, VolumenCT& volumen, VolumeCache* cache,
+                        const std::function<bool(VolumenCT&)>& decodificar);
+    // Decodificación completa con ITK (sin caché)
+    bool decodificarVolumen(const std::string& carpeta, VolumenCT& volumen);
+    bool decodificarArchivos(const std::vector<std::string>& archivos, VolumenCT& volumen);
 };
 
-#endif
\ No newline at end of file
+#endif
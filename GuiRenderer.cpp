@@ -0,0 +1,80 @@
+#include "GuiRenderer.h"
+
+GuiRenderer::GuiRenderer(cv::Size tam, cv::Scalar colorFondo)
+    : fondoBase(tam, CV_8UC3, colorFondo) {
+    fondoBase.copyTo(lienzoActual);
+}
+
+void GuiRenderer::invalidar() {
+    fondoBase.copyTo(lienzoActual);
+    paneles.clear();
+    firmas.clear();
+    sucio = true;
+}
+
+bool GuiRenderer::panel(int id, cv::Rect zona, const cv::Mat& img, uint64_t version,
+                        const std::string& titulo, cv::Scalar colorBorde) {
+    if (img.empty()) return false;
+    PanelCache& p = paneles[id];
+    if (p.valido && p.version == version && p.zona == zona) return false;
+
+    // 1. Fondo, borde y título del panel (solo su rectángulo)
+    cv::rectangle(lienzoActual, zona, cv::Scalar(20, 20, 20), -1);
+    cv::rectangle(lienzoActual, zona, colorBorde, 1);
+    cv::rectangle(lienzoActual, cv::Rect(zona.x, zona.y, zona.width, 25), colorBorde, -1);
+    cv::putText(lienzoActual, titulo, cv::Point(zona.x + 10, zona.y + 18), cv::FONT_HERSHEY_SIMPLEX, 0.45,
+                cv::Scalar(255, 255, 255), 1);
+
+    // 2. Escalar manteniendo la relación de aspecto (nunca se amplía)
+    int hDisp = zona.height - 30;
+    float scale = std::min((float)zona.width / img.cols, (float)hDisp / img.rows);
+    if (scale > 1.0f) scale = 1.0f;
+    cv::Size tam(std::max(1, cvRound(img.cols * scale)), std::max(1, cvRound(img.rows * scale)));
+
+    int xOff = (zona.width - tam.width) / 2;
+    int yOff = 30 + (hDisp - tam.height) / 2;
+    cv::Mat destino = lienzoActual(cv::Rect(zona.x + xOff, zona.y + yOff, tam.width, tam.height));
+
+    // 3. Se escala antes de convertir a color (1 canal en lugar de 3) y se escribe
+    // directamente en el lienzo; el buffer intermedio se reutiliza entre fotogramas
+    if (img.channels() == 1) {
+        cv::resize(img, p.escalada, tam, 0, 0, cv::INTER_LINEAR);
+        cv::cvtColor(p.escalada, destino, cv::COLOR_GRAY2BGR);
+    } else {
+        cv::resize(img, destino, tam, 0, 0, cv::INTER_LINEAR);
+    }
+
+    p.valido = true;
+    p.version = version;
+    p.zona = zona;
+    p.areaImagen = cv::Rect(zona.x + xOff, zona.y + yOff, tam.width, tam.height);
+    p.tamImagen = img.size();
+    sucio = true;
+    numPanelesDibujados++;
+    return true;
+}
+
+bool GuiRenderer::aImagen(int id, cv::Point punto, cv::Point2f& enImagen) const {
+    auto it = paneles.find(id);
+    if (it == paneles.end() || !it->second.valido || !it->second.areaImagen.contains(punto)) return false;
+    const PanelCache& p = it->second;
+    enImagen.x = (punto.x - p.areaImagen.x + 0.5f) * p.tamImagen.width / p.areaImagen.width;
+    enImagen.y = (punto.y - p.areaImagen.y + 0.5f) * p.tamImagen.height / p.areaImagen.height;
+    return true;
+}
+
+bool GuiRenderer::region(int id, cv::Rect zona, size_t firma) {
+    auto it = firmas.find(id);
+    if (it != firmas.end() && it->second == firma) return false;
+    fondoBase(zona).copyTo(lienzoActual(zona));
+    firmas[id] = firma;
+    sucio = true;
+    return true;
+}
+
+bool GuiRenderer::presentar(const std::string& ventana) {
+    if (!sucio) return false;
+    cv::imshow(ventana, lienzoActual);
+    sucio = false;
+    return true;
+}
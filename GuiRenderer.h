@@ -0,0 +1,71 @@
+#ifndef GUIRENDERER_H
+#define GUIRENDERER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+// Renderizador en modo retenido ("retained mode") para la GUI sobre OpenCV.
+// El lienzo persiste entre fotogramas y se divide en capas:
+//  - Fondo estático (chrome): se dibuja una sola vez en fondo().
+//  - Paneles de imagen: guardan la imagen ya escalada y solo se re-rasterizan cuando
+//    cambia la versión de su fuente.
+//  - Regiones dibujadas por el llamador (barras laterales): se restauran desde el fondo
+//    y se repintan solo cuando cambia su firma (hash de lo que muestran).
+// presentar() solo llama a imshow si alguna capa cambió.
+class GuiRenderer {
+public:
+    GuiRenderer(cv::Size tam, cv::Scalar colorFondo);
+
+    // Capa estática: dibujar sobre ella y después llamar a invalidar()
+    cv::Mat& fondo() { return fondoBase; }
+
+    // Lienzo actual (lectura, p.ej. para componer un aviso temporal)
+    const cv::Mat& lienzo() const { return lienzoActual; }
+
+    // Panel de imagen con título y borde; 'version' debe cambiar cada vez que cambie 'img'.
+    // Devuelve true si se re-rasterizó.
+    bool panel(int id, cv::Rect zona, const cv::Mat& img, uint64_t version,
+               const std::string& titulo, cv::Scalar colorBorde);
+
+    // Región libre: si 'firma' cambió, restaura el fondo de 'zona', devuelve true y
+    // el llamador debe repintarla sobre lienzoEditable()
+    bool region(int id, cv::Rect zona, size_t firma);
+    cv::Mat& lienzoEditable() { return lienzoActual; }
+
+    // Muestra el lienzo solo si cambió desde la última vez. Devuelve true si lo mostró.
+    bool presentar(const std::string& ventana);
+
+    // Fuerza mostrar el lienzo en el próximo presentar() (p.ej. tras un aviso superpuesto)
+    void marcarSucio() { sucio = true; }
+
+    // Repinta todo desde el fondo (tras cambiar el chrome)
+    void invalidar();
+
+    // Convierte un punto de la ventana a coordenadas de la imagen del panel 'id'
+    // (según su último dibujado). Devuelve false si el punto no cae sobre la imagen.
+    bool aImagen(int id, cv::Point punto, cv::Point2f& enImagen) const;
+
+    // Paneles re-rasterizados desde el inicio (diagnóstico)
+    size_t panelesDibujados() const { return numPanelesDibujados; }
+
+private:
+    struct PanelCache {
+        bool valido = false;
+        uint64_t version = 0;
+        cv::Rect zona;
+        cv::Mat escalada;   // Imagen ya escalada al panel (se reutiliza)
+        cv::Rect areaImagen;   // Dónde quedó la imagen dentro del lienzo
+        cv::Size tamImagen;    // Tamaño original de la imagen
+    };
+
+    cv::Mat fondoBase;
+    cv::Mat lienzoActual;
+    std::map<int, PanelCache> paneles;
+    std::map<int, size_t> firmas;
+    bool sucio = true;
+    size_t numPanelesDibujados = 0;
+};
+
+#endif
@@ -1,92 +1,414 @@
 #include "ImageProcessor.h"
+#include "Profiler.h"
+#include "ResultExporter.h"
 #include <iostream>
-// Librería para silenciar los errores de consola de OpenCV
-#include <opencv2/core/utils/logger.hpp>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+bool leerOpcionPipeline(const std::vector<std::string>& args, size_t& i, ConfiguracionPipeline& config,
+                        std::string& error) {
+    const std::string& arg = args[i];
+    bool conValor = i + 1 < args.size();
+    if (arg == "--mode" && conValor) {
+        const std::string& modo = args[++i];
+        if (modo == "manual") config.modo = 0;
+        else if (modo == "hueso") config.modo = 1;
+        else if (modo == "pulmon") config.modo = 2;
+        else if (modo == "tejido") config.modo = 3;
+        else error = "Modo desconocido '" + modo + "'.";
+    }
+    else if (arg == "--clahe") config.usarCLAHE = true;
+    else if (arg == "--dnn") config.usarDNN = true;
+    else if (arg == "--filtro" && conValor) {
+        const std::string& filtro = args[++i];
+        if (filtro == "dnn") config.presetRuido = RUIDO_DNN;
+        else if (filtro == "nlm") config.presetRuido = RUIDO_NLM;
+        else if (filtro == "nlm-rapido") config.presetRuido = RUIDO_NLM_RAPIDO;
+        else if (filtro == "bilateral") config.presetRuido = RUIDO_BILATERAL;
+        else if (filtro == "guiado") config.presetRuido = RUIDO_GUIADO;
+        else error = "Filtro desconocido '" + filtro + "'.";
+        config.usarDNN = true;
+    }
+    else if (arg == "--sin-morf") config.usarMorf = false;
+    else if (arg == "--bordes") config.verBordes = true;
+    else if (arg == "--3d") config.usar3D = true;
+    else return false;
+    return true;
+}
 
 void ImageProcessor::cargarRedNeuronal(const std::string& rutaModelo) {
-    // Silenciar logs de carga para mantener la consola limpia
-    cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_SILENT);
-    try {
-        this->redNeuronal = cv::dnn::readNetFromONNX(rutaModelo);
-        // Configuración para CPU (más compatible)
-        this->redNeuronal.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-        this->redNeuronal.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
-        this->redCargada = true;
-    } catch (cv::Exception& e) {
-        this->redCargada = false;
-        // Solo mostramos mensaje amigable, no el error técnico
-        // std::cout << "[INFO] Iniciando en modo algorítmico (Sin modelo ONNX externo)." << std::endl;
-    }
-    // Restaurar logs de errores importantes
-    cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_ERROR);
+    // Sin modelo (o con uno ilegible) el pool queda vacío y se usa el respaldo.
+    // El archivo se comprueba antes de llamar a OpenCV: no hace falta silenciar su log global.
+    compartirRed(InferencePool::cargar(rutaModelo));
+}
+
+void ImageProcessor::compartirRed(std::shared_ptr<InferencePool> pool) {
+    redes = std::move(pool);
+    redFallida = false;
 }
 
+// Identificadores de los buffers intermedios del espacio de trabajo
+enum BufferIntermedio { BUF_OVERLAY_COLOR, BUF_OVERLAY_MEZCLA };
+
 cv::Mat ImageProcessor::aplicarContrastStretching(cv::Mat entrada) {
     cv::Mat salida;
+    aplicarContrastStretching(entrada, salida);
+    return salida;
+}
+
+void ImageProcessor::aplicarContrastStretching(const cv::Mat& entrada, cv::Mat& salida) {
+    // Cortes en HU: la ventana fija mantiene el mismo contraste en toda la serie
+    if (entrada.type() == CV_16SC1) {
+        aplicarVentanaHU(entrada, ventanaMinHU, ventanaMaxHU, salida);
+        return;
+    }
+    espacio.preparar(salida, entrada.size(), entrada.type());
     cv::normalize(entrada, salida, 0, 255, cv::NORM_MINMAX);
+}
+
+uint64_t ImageProcessor::huellaFiltro(int preset) const {
+    int64_t campos[5] = {ventanaMinHU, ventanaMaxHU, 0, 0, 0};
+    if (presetEfectivo(preset) == RUIDO_DNN) {
+        campos[2] = (int64_t)redes->huella();
+        campos[3] = tamTesela;
+        campos[4] = solapeTesela;
+    }
+    uint64_t h = 14695981039346656037ULL;   // FNV-1a
+    const uchar* b = reinterpret_cast<const uchar*>(campos);
+    for (size_t i = 0; i < sizeof(campos); i++) {
+        h ^= b[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void ImageProcessor::setVentanaHU(int minHU, int maxHU) {
+    ventanaMinHU = minHU;
+    ventanaMaxHU = std::max(maxHU, minHU + 1);
+}
+
+cv::Mat ImageProcessor::aplicarVentanaHU(cv::Mat hu, int minHU, int maxHU) {
+    cv::Mat salida;
+    aplicarVentanaHU(hu, minHU, maxHU, salida);
     return salida;
 }
 
+void ImageProcessor::aplicarVentanaHU(const cv::Mat& hu, int minHU, int maxHU, cv::Mat& salida) {
+    TemporizadorEtapa tiempo(PERF_VENTANA);
+    CV_Assert(hu.type() == CV_16SC1);
+
+    // 1. Reconstruir la LUT solo si cambió la ventana
+    if (lutVentana.empty() || lutMinHU != minHU || lutMaxHU != maxHU) {
+        lutVentana.resize(65536);
+        double escala = 255.0 / std::max(1, maxHU - minHU);
+        for (int v = -32768; v <= 32767; v++) {
+            double y = (v - minHU) * escala;
+            lutVentana[v + 32768] = cv::saturate_cast<uchar>(y);
+        }
+        lutMinHU = minHU;
+        lutMaxHU = maxHU;
+    }
+
+    // 2. Una sola pasada: HU -> 8 bits por consulta directa a la tabla
+    espacio.preparar(salida, hu.size(), CV_8UC1);
+    const uchar* lut = lutVentana.data() + 32768;
+    cv::parallel_for_(cv::Range(0, hu.rows), [&](const cv::Range& filas) {
+        for (int y = filas.start; y < filas.end; y++) {
+            const short* src = hu.ptr<short>(y);
+            uchar* dst = salida.ptr<uchar>(y);
+            for (int x = 0; x < hu.cols; x++) dst[x] = lut[src[x]];
+        }
+    });
+}
+
 cv::Mat ImageProcessor::mejorarContraste(cv::Mat entrada, bool usarCLAHE) {
     cv::Mat salida;
+    mejorarContraste(entrada, usarCLAHE, salida);
+    return salida;
+}
+
+void ImageProcessor::mejorarContraste(const cv::Mat& entrada, bool usarCLAHE, cv::Mat& salida) {
+    TemporizadorEtapa tiempo(PERF_CLAHE);
+    if (!usarCLAHE) tiempo.cancelar();
+    espacio.preparar(salida, entrada.size(), entrada.type());
     if (usarCLAHE) {
-        auto clahe = cv::createCLAHE(2.0, cv::Size(8, 8));
-        clahe->apply(entrada, salida);
+        // Instancia persistente: sus tablas internas también se reutilizan
+        espacio.clahe()->apply(entrada, salida);
     } else {
-        salida = entrada.clone(); 
+        entrada.copyTo(salida);
     }
-    return salida;
 }
 
-cv::Mat ImageProcessor::aplicarReduccionRuido(cv::Mat entrada, bool usarDNN) {
-    cv::Mat salida = entrada.clone();
-
-    if (usarDNN) {
-        bool dnnExitoso = false;
-
-        // 1. INTENTO CON INTELIGENCIA ARTIFICIAL
-        if (redCargada) {
-            // TRUCO DE INGENIERÍA: 
-            // Silenciamos OpenCV temporalmente para que si el modelo falla por tamaños
-            // incorrectos (Error Reshape -1), no ensucie la consola con texto rojo.
-            cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_SILENT);
-            
-            try {
-                cv::Mat blob = cv::dnn::blobFromImage(entrada, 1.0/255.0);
-                redNeuronal.setInput(blob);
-                
-                // Si esto falla, saltará al catch SIN imprimir error en consola
-                cv::Mat resultado = redNeuronal.forward();
-
-                std::vector<cv::Mat> imagenes;
-                cv::dnn::imagesFromBlob(resultado, imagenes);
-                
-                if (!imagenes.empty()) {
-                    imagenes[0].convertTo(salida, CV_8U, 255.0);
-                    // Asegurar mismo tamaño por si el modelo deformó la imagen
-                    if (salida.size() != entrada.size()) {
-                        cv::resize(salida, salida, entrada.size());
-                    }
-                    dnnExitoso = true;
-                }
-            } catch (...) {
-                // Captura silenciosa: Falló la IA, no pasa nada.
-                dnnExitoso = false;
+void ImageProcessor::configurarInferencia(int tamLote) {
+    this->tamLote = std::max(1, tamLote);
+}
+
+void ImageProcessor::configurarTeselas(int tam, int solape) {
+    tamTesela = std::max(8, tam);
+    solapeTesela = std::min(std::max(0, solape), tamTesela / 2);
+    ventanaMezcla.release();
+    redFallida = false;
+}
+
+// Posiciones de las teselas a lo largo de un eje: paso fijo y la última pegada al borde
+static std::vector<int> posicionesTeselas(int dim, int tam, int paso) {
+    std::vector<int> pos;
+    for (int v = 0; ; v += paso) {
+        if (v + tam >= dim) {
+            pos.push_back(dim - tam);
+            break;
+        }
+        pos.push_back(v);
+    }
+    return pos;
+}
+
+bool ImageProcessor::inferirPorTeselas(const std::vector<cv::Mat>& entradas, std::vector<cv::Mat>& salidas) {
+    if (!redDisponible() || entradas.empty()) return false;
+    TemporizadorEtapa tiempo(PERF_DNN);
+    // Instancia de la red solo para este hilo mientras dure la inferencia
+    InferencePool::Prestamo prestamo = redes->tomar();
+    const int T = tamTesela;
+    const int paso = std::max(1, T - solapeTesela);
+
+    // 1. Ventana de mezcla (Hann 2D): pesa poco los bordes de cada tesela para ocultar las costuras
+    if (ventanaMezcla.rows != T) {
+        cv::Mat w1(1, T, CV_32F);
+        for (int i = 0; i < T; i++) w1.at<float>(i) = (float)(0.5 - 0.5 * std::cos(2.0 * CV_PI * (i + 0.5) / T));
+        ventanaMezcla = w1.t() * w1;
+    }
+
+    // 2. Cortar cada imagen en teselas TxT solapadas (se rellena si es más pequeña que T)
+    struct Tesela { size_t imagen; int x, y; };
+    std::vector<Tesela> teselas;
+    std::vector<cv::Mat> rellenas(entradas.size()), acum(entradas.size()), peso(entradas.size());
+    for (size_t i = 0; i < entradas.size(); i++) {
+        const cv::Mat& e = entradas[i];
+        int extraY = std::max(0, T - e.rows), extraX = std::max(0, T - e.cols);
+        if (extraY || extraX) cv::copyMakeBorder(e, rellenas[i], 0, extraY, 0, extraX, cv::BORDER_REPLICATE);
+        else rellenas[i] = e;
+
+        acum[i] = cv::Mat::zeros(rellenas[i].size(), CV_32F);
+        peso[i] = cv::Mat::zeros(rellenas[i].size(), CV_32F);
+        for (int y : posicionesTeselas(rellenas[i].rows, T, paso)) {
+            for (int x : posicionesTeselas(rellenas[i].cols, T, paso)) teselas.push_back({i, x, y});
+        }
+    }
+
+    // 3. Lotes de 'tamLote' teselas por pasada de la red (memoria fija: tamLote x T x T)
+    for (size_t t0 = 0; t0 < teselas.size(); t0 += tamLote) {
+        size_t n = std::min((size_t)tamLote, teselas.size() - t0);
+        int dims[4] = {(int)n, 1, T, T};
+        blobEntrada.create(4, dims, CV_32F);
+        for (size_t k = 0; k < n; k++) {
+            const Tesela& ts = teselas[t0 + k];
+            cv::Mat plano(T, T, CV_32F, blobEntrada.ptr<float>((int)k));
+            rellenas[ts.imagen](cv::Rect(ts.x, ts.y, T, T)).convertTo(plano, CV_32F, 1.0 / 255.0);
+        }
+
+        bool ok = true;
+        try {
+            prestamo.red().setInput(blobEntrada);
+            prestamo.red().forward(blobSalida);
+        } catch (cv::Exception&) {
+            ok = false;
+        }
+        ok = ok && blobSalida.dims == 4 && blobSalida.size[0] == (int)n
+                && blobSalida.size[2] > 0 && blobSalida.size[3] > 0;
+        if (!ok) {
+            // Avisamos una sola vez (aunque el pool lo compartan varios hilos):
+            // a partir de aquí se usa el plan de respaldo
+            redFallida = true;
+            tiempo.cancelar();
+            if (redes->marcarFallida()) {
+                std::cout << "[AVISO] La red no acepta teselas de " << T << "x" << T
+                          << ". Se usara Non-Local Means." << std::endl;
+            }
+            return false;
+        }
+
+        // Acumular cada tesela ponderada por la ventana. La escala sale de la forma de la
+        // salida: un modelo de superresolución (el dncnn.onnx incluido devuelve 3T x 3T)
+        // se promedia de vuelta a T x T con INTER_AREA antes de mezclar
+        const cv::Size tamSalida(blobSalida.size[3], blobSalida.size[2]);
+        for (size_t k = 0; k < n; k++) {
+            const Tesela& ts = teselas[t0 + k];
+            cv::Mat plano(tamSalida, CV_32F, blobSalida.ptr<float>((int)k));   // Canal 0 de la tesela k
+            if (tamSalida != cv::Size(T, T)) {
+                cv::resize(plano, teselaReducida, cv::Size(T, T), 0, 0, cv::INTER_AREA);
+                plano = teselaReducida;
             }
-            
-            // Reactivar logs normales
-            cv::utils::logging::setLogLevel(cv::utils::logging::LOG_LEVEL_ERROR);
+            cv::Rect r(ts.x, ts.y, T, T);
+            cv::Mat a = acum[ts.imagen](r);
+            cv::Mat p = peso[ts.imagen](r);
+            cv::accumulateProduct(plano, ventanaMezcla, a);
+            cv::accumulate(ventanaMezcla, p);
         }
+    }
+
+    // 4. Normalizar por la suma de pesos y recortar el relleno
+    for (size_t i = 0; i < entradas.size(); i++) {
+        cv::Mat mezcla;
+        cv::divide(acum[i], peso[i], mezcla);
+        mezcla(cv::Rect(0, 0, entradas[i].cols, entradas[i].rows)).convertTo(salidas[i], CV_8U, 255.0);
+    }
+    return true;
+}
+
+// --- FILTROS CLÁSICOS DE REDUCCIÓN DE RUIDO ---
+
+// Parámetros de cada preset clásico
+static const int NLM_H = 10, NLM_PLANTILLA = 7, NLM_BUSQUEDA = 21, NLM_BUSQUEDA_RAPIDA = 11;
+static const int BILATERAL_D = 7;
+static const double BILATERAL_SIGMA_COLOR = 30.0, BILATERAL_SIGMA_ESPACIO = 5.0;
+static const int GUIADO_RADIO = 4;
+static const double GUIADO_EPS = 400.0;   // ~ (20 niveles de gris)^2: por debajo se suaviza, por encima es borde
+
+// Filas de contexto que necesita cada filtro por encima y por debajo de una franja
+// para que el resultado sea idéntico al de filtrar la imagen entera
+static int margenPreset(int preset) {
+    switch (preset) {
+        case RUIDO_NLM:        return NLM_BUSQUEDA / 2 + NLM_PLANTILLA / 2;
+        case RUIDO_NLM_RAPIDO: return NLM_BUSQUEDA_RAPIDA / 2 + NLM_PLANTILLA / 2;
+        case RUIDO_BILATERAL:  return BILATERAL_D / 2;
+        case RUIDO_GUIADO:     return 2 * GUIADO_RADIO;   // Dos filtros de caja encadenados
+        default:               return 0;
+    }
+}
+
+// Filtro guiado autoguiado (He et al.): q = media(a) * I + media(b), con a = var / (var + eps).
+// Solo filtros de caja separables y operaciones por elemento (vectorizadas en OpenCV).
+static void filtroGuiado(const cv::Mat& entrada, cv::Mat& salida, int radio, double eps) {
+    cv::Size caja(2 * radio + 1, 2 * radio + 1);
+    cv::Mat I, media, media2, var, a, b;
+    entrada.convertTo(I, CV_32F);
+    cv::boxFilter(I, media, CV_32F, caja);
+    cv::sqrBoxFilter(I, media2, CV_32F, caja);
+    var = media2 - media.mul(media);
+    cv::divide(var, var + eps, a);
+    b = media - a.mul(media);
+    cv::boxFilter(a, a, CV_32F, caja);
+    cv::boxFilter(b, b, CV_32F, caja);
+    cv::Mat q = a.mul(I) + b;
+    q.convertTo(salida, CV_8U);
+}
+
+static void aplicarPreset(const cv::Mat& entrada, cv::Mat& salida, int preset) {
+    switch (preset) {
+        case RUIDO_NLM_RAPIDO:
+            cv::fastNlMeansDenoising(entrada, salida, NLM_H, NLM_PLANTILLA, NLM_BUSQUEDA_RAPIDA);
+            break;
+        case RUIDO_BILATERAL:
+            cv::bilateralFilter(entrada, salida, BILATERAL_D, BILATERAL_SIGMA_COLOR, BILATERAL_SIGMA_ESPACIO);
+            break;
+        case RUIDO_GUIADO:
+            filtroGuiado(entrada, salida, GUIADO_RADIO, GUIADO_EPS);
+            break;
+        default:
+            cv::fastNlMeansDenoising(entrada, salida, NLM_H, NLM_PLANTILLA, NLM_BUSQUEDA);
+            break;
+    }
+}
+
+cv::Mat ImageProcessor::filtrarRuido(const cv::Mat& entrada, int preset) {
+    TemporizadorEtapa tiempo(PERF_FILTRO_RUIDO);
+    CV_Assert(entrada.type() == CV_8UC1);
+    if (preset == RUIDO_DNN) preset = RUIDO_NLM;
+    cv::Mat salida(entrada.size(), CV_8UC1);
+
+    // 1. Repartir las filas en franjas (una por hilo, mínimo 32 filas para que el margen compense)
+    const int margen = margenPreset(preset);
+    const int numFranjas = std::max(1, std::min(cv::getNumThreads(), entrada.rows / 32));
+    const int altoFranja = (entrada.rows + numFranjas - 1) / numFranjas;
 
+    // 2. Cada franja se filtra con 'margen' filas de contexto y solo se copia su parte central.
+    // La franja se clona para que el filtro vea una imagen aislada (sin leer fuera del ROI).
+    cv::parallel_for_(cv::Range(0, numFranjas), [&](const cv::Range& rango) {
+        for (int f = rango.start; f < rango.end; f++) {
+            int y0 = f * altoFranja;
+            int y1 = std::min(entrada.rows, y0 + altoFranja);
+            if (y0 >= y1) continue;
+            int e0 = std::max(0, y0 - margen);
+            int e1 = std::min(entrada.rows, y1 + margen);
+
+            cv::Mat franja = entrada.rowRange(e0, e1).clone(), filtrada;
+            aplicarPreset(franja, filtrada, preset);
+            filtrada.rowRange(y0 - e0, y1 - e0).copyTo(salida.rowRange(y0, y1));
+        }
+    });
+    return salida;
+}
+
+void ImageProcessor::registrarLatencia(int preset, int64 ticks, size_t cortes) {
+    if (cortes == 0 || preset < 0 || preset >= NUM_PRESETS_RUIDO) return;
+    double ms = ticks * 1000.0 / cv::getTickFrequency() / cortes;
+    // Media móvil exponencial: estable en la GUI y reacciona en pocos cortes
+    latenciaMs[preset] = latenciaMs[preset] > 0 ? 0.8 * latenciaMs[preset] + 0.2 * ms : ms;
+}
+
+double ImageProcessor::latenciaRuido(int preset) const {
+    if (preset < 0 || preset >= NUM_PRESETS_RUIDO) return 0.0;
+    return latenciaMs[preset];
+}
+
+const char* ImageProcessor::nombrePresetRuido(int preset) {
+    switch (preset) {
+        case RUIDO_DNN:        return "DnCNN";
+        case RUIDO_NLM:        return "NL-Means";
+        case RUIDO_NLM_RAPIDO: return "NL-Means rapido";
+        case RUIDO_BILATERAL:  return "Bilateral";
+        case RUIDO_GUIADO:     return "Guiado";
+        default:               return "?";
+    }
+}
+
+std::vector<cv::Mat> ImageProcessor::aplicarReduccionRuidoLote(const std::vector<cv::Mat>& entradas, bool usarDNN,
+                                                               int preset) {
+    std::vector<cv::Mat> salidas(entradas.size());
+    if (!usarDNN) {
+        for (size_t i = 0; i < entradas.size(); i++) salidas[i] = entradas[i].clone();
+        return salidas;
+    }
+
+    // 1. INTENTO CON INTELIGENCIA ARTIFICIAL: teselas del tamaño del modelo, en lotes
+    const int solicitado = preset;
+    if (preset == RUIDO_DNN) {
+        int64 t0 = cv::getTickCount();
+        if (inferirPorTeselas(entradas, salidas)) {
+            registrarLatencia(RUIDO_DNN, cv::getTickCount() - t0, entradas.size());
+            return salidas;
+        }
         // 2. PLAN DE RESPALDO (Non-Local Means)
         // Se ejecuta automáticamente si la IA falló o no estaba cargada.
         // Esto garantiza que el botón "DNN" SIEMPRE limpie la imagen.
-        if (!dnnExitoso) {
-            cv::fastNlMeansDenoising(entrada, salida, 10, 7, 21);
-        }
+        preset = RUIDO_NLM;
     }
-    
-    return salida;
+
+    // 3. FILTRO CLÁSICO del preset elegido
+    int64 t0 = cv::getTickCount();
+    for (size_t k = 0; k < entradas.size(); k++) {
+        salidas[k] = filtrarRuido(entradas[k], preset);
+    }
+    int64 ticks = cv::getTickCount() - t0;
+    registrarLatencia(preset, ticks, entradas.size());
+    // Sin modelo, la latencia del preset DnCNN es la de su respaldo
+    if (solicitado != preset) registrarLatencia(solicitado, ticks, entradas.size());
+    return salidas;
+}
+
+cv::Mat ImageProcessor::aplicarReduccionRuido(cv::Mat entrada, bool usarDNN, int preset) {
+    std::vector<cv::Mat> entradas(1, entrada);
+    return aplicarReduccionRuidoLote(entradas, usarDNN, preset)[0];
+}
+
+void ImageProcessor::aplicarReduccionRuido(const cv::Mat& entrada, bool usarDNN, int preset, cv::Mat& salida) {
+    if (!usarDNN) {
+        espacio.preparar(salida, entrada.size(), entrada.type());
+        entrada.copyTo(salida);
+        return;
+    }
+    salida = aplicarReduccionRuido(entrada, usarDNN, preset);
 }
 
 cv::Mat ImageProcessor::detectarBordes(cv::Mat entrada, double umbralBajo, double umbralAlto) {
@@ -95,68 +417,108 @@ cv::Mat ImageProcessor::detectarBordes(cv::Mat entrada, double umbralBajo, doubl
     return bordes;
 }
 
-cv::Mat ImageProcessor::limpiarMascara(cv::Mat mascara, int tipoMorfologico) {
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-    cv::morphologyEx(mascara, mascara, tipoMorfologico, kernel);
+cv::Mat ImageProcessor::limpiarMascara(const cv::Mat& mascara, int tipoMorfologico) {
+    cv::Mat salida;
+    limpiarMascara(mascara, tipoMorfologico, salida);
+    return salida;
+}
+
+void ImageProcessor::limpiarMascara(const cv::Mat& mascara, int tipoMorfologico, cv::Mat& salida) {
+    espacio.preparar(salida, mascara.size(), mascara.type());
+    cv::morphologyEx(mascara, salida, tipoMorfologico, espacio.elemento(cv::MORPH_RECT, 3));
+}
+
+cv::Mat ImageProcessor::umbralizarHU(cv::Mat hu, int minHU, int maxHU) {
+    cv::Mat mascara;
+    umbralizarHU(hu, minHU, maxHU, mascara);
     return mascara;
 }
 
-cv::Mat ImageProcessor::segmentarHueso(cv::Mat entrada) {
+void ImageProcessor::umbralizarHU(const cv::Mat& hu, int minHU, int maxHU, cv::Mat& mascara) {
+    espacio.preparar(mascara, hu.size(), CV_8UC1);
+    cv::inRange(hu, cv::Scalar(minHU), cv::Scalar(maxHU), mascara);
+}
+
+cv::Mat ImageProcessor::segmentarHueso(cv::Mat hu) {
     cv::Mat mascara;
-    cv::threshold(entrada, mascara, 200, 255, cv::THRESH_BINARY);
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5));
-    cv::morphologyEx(mascara, mascara, cv::MORPH_CLOSE, kernel);
+    segmentarHueso(hu, mascara);
     return mascara;
 }
 
-cv::Mat ImageProcessor::segmentarPulmon(cv::Mat entrada) {
+void ImageProcessor::segmentarHueso(const cv::Mat& hu, cv::Mat& mascara) {
+    umbralizarHU(hu, HU_HUESO_MIN, SHRT_MAX, mascara);
+    cv::morphologyEx(mascara, mascara, cv::MORPH_CLOSE, espacio.elemento(cv::MORPH_ELLIPSE, 5));
+}
+
+cv::Mat ImageProcessor::segmentarPulmon(cv::Mat hu) {
     cv::Mat mascara;
-    cv::threshold(entrada, mascara, 60, 255, cv::THRESH_BINARY_INV);
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
-    cv::morphologyEx(mascara, mascara, cv::MORPH_OPEN, kernel);
+    segmentarPulmon(hu, mascara);
     return mascara;
 }
 
-cv::Mat ImageProcessor::segmentarTejidoBlando(cv::Mat entrada) {
+void ImageProcessor::segmentarPulmon(const cv::Mat& hu, cv::Mat& mascara) {
+    umbralizarHU(hu, SHRT_MIN, HU_PULMON_MAX, mascara);
+    cv::morphologyEx(mascara, mascara, cv::MORPH_OPEN, espacio.elemento(cv::MORPH_ELLIPSE, 3));
+}
+
+cv::Mat ImageProcessor::segmentarTejidoBlando(cv::Mat hu) {
     cv::Mat mascara;
-    cv::inRange(entrada, cv::Scalar(50), cv::Scalar(150), mascara);
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
-    cv::morphologyEx(mascara, mascara, cv::MORPH_OPEN, kernel);
+    segmentarTejidoBlando(hu, mascara);
     return mascara;
 }
 
+void ImageProcessor::segmentarTejidoBlando(const cv::Mat& hu, cv::Mat& mascara) {
+    umbralizarHU(hu, HU_TEJIDO_MIN, HU_TEJIDO_MAX, mascara);
+    cv::morphologyEx(mascara, mascara, cv::MORPH_OPEN, espacio.elemento(cv::MORPH_ELLIPSE, 3));
+}
+
 cv::Mat ImageProcessor::crearOverlay(cv::Mat original, cv::Mat mascara, cv::Scalar color) {
     cv::Mat resultado;
+    crearOverlay(original, mascara, color, resultado);
+    return resultado;
+}
+
+void ImageProcessor::crearOverlay(const cv::Mat& original, const cv::Mat& mascara, cv::Scalar color, cv::Mat& resultado) {
+    TemporizadorEtapa tiempo(PERF_OVERLAY);
+    espacio.preparar(resultado, original.size(), CV_8UC3);
     cv::cvtColor(original, resultado, cv::COLOR_GRAY2BGR);
     
     if (cv::countNonZero(mascara) > 0) {
-        cv::Mat colorMask(original.size(), CV_8UC3, color);
-        cv::Mat mascaraColor;
+        cv::Mat& colorMask = espacio.buffer(BUF_OVERLAY_COLOR, original.size(), CV_8UC3);
+        cv::Mat& mascaraColor = espacio.buffer(BUF_OVERLAY_MEZCLA, original.size(), CV_8UC3);
+        colorMask.setTo(color);
         resultado.copyTo(mascaraColor); 
         colorMask.copyTo(mascaraColor, mascara);
         cv::addWeighted(mascaraColor, 0.4, resultado, 0.6, 0, resultado);
     }
-    return resultado;
 }
 
 cv::Mat ImageProcessor::aplicarApertura(cv::Mat mascara) {
     cv::Mat salida;
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
-    cv::morphologyEx(mascara, salida, cv::MORPH_OPEN, kernel);
+    aplicarApertura(mascara, salida);
     return salida;
 }
 
+void ImageProcessor::aplicarApertura(const cv::Mat& mascara, cv::Mat& salida) {
+    espacio.preparar(salida, mascara.size(), mascara.type());
+    cv::morphologyEx(mascara, salida, cv::MORPH_OPEN, espacio.elemento(cv::MORPH_ELLIPSE, 3));
+}
+
 cv::Mat ImageProcessor::aplicarGradienteMorfologico(cv::Mat mascara) {
     cv::Mat salida;
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-    cv::morphologyEx(mascara, salida, cv::MORPH_GRADIENT, kernel);
+    aplicarGradienteMorfologico(mascara, salida);
     return salida;
 }
 
-#include <sys/stat.h> 
+void ImageProcessor::aplicarGradienteMorfologico(const cv::Mat& mascara, cv::Mat& salida) {
+    espacio.preparar(salida, mascara.size(), mascara.type());
+    cv::morphologyEx(mascara, salida, cv::MORPH_GRADIENT, espacio.elemento(cv::MORPH_RECT, 3));
+}
 
 void ImageProcessor::guardarResultados(const std::string& nombreBase, cv::Mat orig, cv::Mat proc, cv::Mat mask, cv::Mat final) {
-    system("mkdir -p Resultados_Output"); 
+    TemporizadorEtapa tiempo(PERF_GUARDADO);
+    // Versión síncrona (la GUI y el modo lote usan ResultExporter, que escribe en segundo plano)
+    ResultExporter::crearDirectorios("Resultados_Output");
 
     std::string ruta = "Resultados_Output/" + nombreBase;
     size_t lastindex = ruta.find_last_of("."); 
@@ -168,4 +530,317 @@ void ImageProcessor::guardarResultados(const std::string& nombreBase, cv::Mat or
     cv::imwrite(rawName + "_4_Final.png", final);
     
     std::cout << " [GUARDADO] Imagenes guardadas en carpeta: Resultados_Output" << std::endl;
-}
\ No newline at end of file
+}
+
+// --- PIPELINE COMPLETO ---
+// Misma secuencia que ejecutaba el bucle de la GUI, ahora reutilizable por el modo lote.
+
+cv::Mat ImageProcessor::preprocesar(cv::Mat entrada, bool usarCLAHE, bool usarDNN) {
+    // 1. Estiramiento de Contraste (Base)
+    cv::Mat base, contraste, salida;
+    aplicarContrastStretching(entrada, base);
+    // 2. Filtros Opcionales
+    mejorarContraste(base, usarCLAHE, contraste);
+    aplicarReduccionRuido(contraste, usarDNN, RUIDO_DNN, salida);
+    return salida;
+}
+
+cv::Scalar ImageProcessor::colorModo(int modo) {
+    switch (modo) {
+        case 1: return cv::Scalar(0, 0, 255);   // Rojo (Hueso)
+        case 2: return cv::Scalar(255, 0, 0);   // Azul (Pulmón)
+        case 3: return cv::Scalar(0, 255, 0);   // Verde (Tejido)
+        default: return cv::Scalar(0, 255, 255); // Amarillo (Manual)
+    }
+}
+
+const char* ImageProcessor::nombreModo(int modo) {
+    switch (modo) {
+        case 1:  return "Hueso";
+        case 2:  return "Pulmon";
+        case 3:  return "Tejido";
+        default: return "Manual";
+    }
+}
+
+cv::Mat ImageProcessor::segmentarSegunModo(cv::Mat hu, cv::Mat procesada, const ConfiguracionPipeline& config,
+                                           cv::Mat mascaraPrevia) {
+    cv::Mat mask;
+    segmentarSegunModo(hu, procesada, config, mascaraPrevia, mask);
+    return mask;
+}
+
+void ImageProcessor::segmentarSegunModo(const cv::Mat& hu, const cv::Mat& procesada, const ConfiguracionPipeline& config,
+                                        const cv::Mat& mascaraPrevia, cv::Mat& mask) {
+    TemporizadorEtapa tiempo(PERF_SEGMENTACION);
+    // Máscara ya calculada fuera (segmentación 3D): ya viene limpia
+    if (!mascaraPrevia.empty()) {
+        espacio.preparar(mask, mascaraPrevia.size(), CV_8UC1);
+        mascaraPrevia.copyTo(mask);
+        return;
+    }
+
+    // --- LÓGICA DE SEGMENTACIÓN ---
+    // Los presets trabajan en HU; el modo manual sobre la imagen procesada (8 bits)
+    switch (config.modo) {
+        case 0: // Manual
+            espacio.preparar(mask, procesada.size(), CV_8UC1);
+            cv::inRange(procesada, cv::Scalar(50), cv::Scalar(200), mask);
+            break;
+        case 1: // Hueso (>200 HU) + Cierre Morfológico
+            if (config.usarMorf) segmentarHueso(hu, mask);
+            else umbralizarHU(hu, HU_HUESO_MIN, SHRT_MAX, mask);
+            break;
+        case 2: // Pulmon (< -600 HU): aire
+            umbralizarHU(hu, SHRT_MIN, HU_PULMON_MAX, mask);
+            break;
+        case 3: // Tejido (Rango Medio)
+            if (config.usarMorf) segmentarTejidoBlando(hu, mask);
+            else umbralizarHU(hu, HU_TEJIDO_MIN, HU_TEJIDO_MAX, mask);
+            break;
+    }
+
+    // --- REFINAMIENTO MORFOLÓGICO ADICIONAL ---
+    // Sin morfología queda el umbral HU crudo, para demostrar la diferencia
+    if (config.usarMorf) {
+        // Aplicar APERTURA (Opening) para quitar ruido en Pulmón y Tejido
+        if (config.modo == 2 || config.modo == 3 || config.modo == 0) {
+            cv::morphologyEx(mask, mask, cv::MORPH_OPEN, espacio.elemento(cv::MORPH_ELLIPSE, 3));
+        }
+    }
+    // VER BORDES no cambia la máscara: los contornos se trazan aparte (trazarContornos)
+}
+
+void ImageProcessor::trazarContornos(const cv::Mat& mascara, const ConfiguracionPipeline& config,
+                                     ContornosCorte& contornos, cv::Mat& final) {
+    if (!config.verBordes) {
+        contornos.clear();
+        return;
+    }
+    extractorContornos.extraer(mascara, contornos);
+    ContourExtractor::dibujar(final, contornos, colorModo(config.modo));
+}
+
+// --- KERNEL FUSIONADO: UMBRAL + MORFOLOGÍA + OVERLAY ---
+// La cadena umbral -> apertura/cierre -> (gradiente) -> overlay se calcula por franjas de
+// FRANJA_FUSION filas. Cada franja umbraliza sus filas más un margen (la suma de los radios
+// de la morfología), aplica cada paso sobre un margen cada vez menor y termina escribiendo la
+// máscara y el overlay de sus filas: los datos intermedios no salen de la caché.
+
+static const int FRANJA_FUSION = 32;
+
+// Elementos estructurantes usados por el pipeline (idénticos a getStructuringElement):
+//   CRUZ_3   = ELLIPSE 3x3      ELIPSE_5 = ELLIPSE 5x5
+enum ElementoFusion { CRUZ_3, ELIPSE_5 };
+struct PasoFusion { ElementoFusion elemento; bool dilatar; };
+
+static inline int radioElemento(ElementoFusion e) { return e == ELIPSE_5 ? 2 : 1; }
+
+struct OpMax { static inline uchar f(uchar a, uchar b) { return a > b ? a : b; } };
+struct OpMin { static inline uchar f(uchar a, uchar b) { return a < b ? a : b; } };
+
+// Min/Max horizontal de radio r. Fuera de la imagen no hay vecinos (igual que el borde
+// por defecto de morphologyEx); el bucle interior no tiene ramas y el compilador lo vectoriza.
+template<class Op>
+static void pasadaHorizontal(const uchar* s, uchar* d, int cols, int r) {
+    for (int x = 0; x < cols; x++) {
+        if (x == r && cols - r > r) x = cols - r;   // Salta el interior: va en el bucle de abajo
+        uchar v = s[x];
+        for (int k = std::max(0, x - r); k <= std::min(cols - 1, x + r); k++) v = Op::f(v, s[k]);
+        d[x] = v;
+    }
+    if (r == 1) {
+        for (int x = 1; x < cols - 1; x++) d[x] = Op::f(Op::f(s[x - 1], s[x]), s[x + 1]);
+    } else {
+        for (int x = 2; x < cols - 2; x++)
+            d[x] = Op::f(Op::f(Op::f(s[x - 2], s[x - 1]), Op::f(s[x], s[x + 1])), s[x + 2]);
+    }
+}
+
+template<class Op>
+static inline void combinarFila(uchar* d, const uchar* s, int cols) {
+    if (!s) return;
+    for (int x = 0; x < cols; x++) d[x] = Op::f(d[x], s[x]);
+}
+
+// Un paso morfológico sobre las filas [f0, f1) (absolutas). 'src' y 'dst' guardan la fila y
+// en (y - base) * cols; 'horiz' es el resultado horizontal de las filas fuente [s0, s1).
+template<class Op>
+static void pasoMorfologico(ElementoFusion e, const uchar* src, uchar* horiz, uchar* dst,
+                            int base, int s0, int s1, int f0, int f1, int filas, int cols) {
+    const int r = radioElemento(e);
+    for (int y = s0; y < s1; y++) pasadaHorizontal<Op>(src + (y - base) * cols, horiz + (y - base) * cols, cols, r);
+
+    auto fila = [&](const uchar* buf, int y) -> const uchar* {
+        return (y >= 0 && y < filas) ? buf + (y - base) * cols : nullptr;
+    };
+    for (int y = f0; y < f1; y++) {
+        uchar* d = dst + (y - base) * cols;
+        memcpy(d, horiz + (y - base) * cols, cols);
+        switch (e) {
+            case CRUZ_3:    // Fila central completa + píxel central de arriba/abajo
+                combinarFila<Op>(d, fila(src, y - 1), cols);
+                combinarFila<Op>(d, fila(src, y + 1), cols);
+                break;
+            case ELIPSE_5:  // Tres filas centrales de ancho 5 + píxel central a distancia 2
+                combinarFila<Op>(d, fila(horiz, y - 1), cols);
+                combinarFila<Op>(d, fila(horiz, y + 1), cols);
+                combinarFila<Op>(d, fila(src, y - 2), cols);
+                combinarFila<Op>(d, fila(src, y + 2), cols);
+                break;
+        }
+    }
+}
+
+void ImageProcessor::segmentarYSuperponer(const cv::Mat& hu, const cv::Mat& procesada, const ConfiguracionPipeline& config,
+                                          const cv::Mat& mascaraPrevia, cv::Mat& mascara, cv::Mat& final) {
+    TemporizadorEtapa tiempo(PERF_SEGMENTACION);
+    CV_Assert(procesada.type() == CV_8UC1);
+
+    // 1. Plan: fuente del umbral y pasos morfológicos equivalentes a segmentarSegunModo.
+    // La apertura es idempotente: en Tejido la del preset y la del refinamiento son una sola.
+    const cv::Mat* fuente = &hu;
+    int minV = 0, maxV = 0;
+    PasoFusion pasos[2];
+    int numPasos = 0;
+    if (!mascaraPrevia.empty()) {
+        fuente = &mascaraPrevia;   // Máscara 3D: se copia tal cual
+    } else {
+        switch (config.modo) {
+            case 1: minV = HU_HUESO_MIN;  maxV = SHRT_MAX;      break;
+            case 2: minV = SHRT_MIN;      maxV = HU_PULMON_MAX; break;
+            case 3: minV = HU_TEJIDO_MIN; maxV = HU_TEJIDO_MAX; break;
+            default: fuente = &procesada; minV = 50; maxV = 200; break;
+        }
+        if (config.usarMorf) {
+            if (config.modo == 1) {   // Cierre 5x5
+                pasos[numPasos++] = {ELIPSE_5, true};
+                pasos[numPasos++] = {ELIPSE_5, false};
+            } else {                  // Apertura 3x3
+                pasos[numPasos++] = {CRUZ_3, false};
+                pasos[numPasos++] = {CRUZ_3, true};
+            }
+        }
+    }
+
+    int margenTotal = 0;
+    for (int k = 0; k < numPasos; k++) margenTotal += radioElemento(pasos[k].elemento);
+
+    const int filas = procesada.rows, cols = procesada.cols;
+    CV_Assert(fuente->size() == procesada.size());
+    mascara.create(procesada.size(), CV_8UC1);
+    final.create(procesada.size(), CV_8UC3);
+
+    // 2. Mezcla alfa precalculada: 0.4 * color + 0.6 * gris (lo mismo que addWeighted)
+    cv::Scalar color = colorModo(config.modo);
+    uchar mezcla[3][256];
+    for (int c = 0; c < 3; c++) {
+        for (int g = 0; g < 256; g++) mezcla[c][g] = cv::saturate_cast<uchar>(color[c] * 0.4 + g * 0.6);
+    }
+
+    // 3. Franjas en paralelo; los buffers son por hilo y se reutilizan entre fotogramas
+    const int numFranjas = (filas + FRANJA_FUSION - 1) / FRANJA_FUSION;
+    cv::parallel_for_(cv::Range(0, numFranjas), [&](const cv::Range& rango) {
+        thread_local std::vector<uchar> bufA, bufB, bufH;
+        for (int f = rango.start; f < rango.end; f++) {
+            const int y0 = f * FRANJA_FUSION, y1 = std::min(filas, y0 + FRANJA_FUSION);
+            const int base = std::max(0, y0 - margenTotal);
+            const int limite = std::min(filas, y1 + margenTotal);
+            const size_t n = (size_t)(limite - base) * cols;
+            if (bufA.size() < n) { bufA.resize(n); bufB.resize(n); bufH.resize(n); }
+            uchar* a = bufA.data();
+            uchar* b = bufB.data();
+
+            // 3.1 Umbral de las filas de la franja más el margen
+            for (int y = base; y < limite; y++) {
+                uchar* d = a + (y - base) * cols;
+                if (fuente == &mascaraPrevia) {
+                    memcpy(d, fuente->ptr<uchar>(y), cols);
+                } else if (fuente->type() == CV_16SC1) {
+                    const short* sh = fuente->ptr<short>(y);
+                    for (int x = 0; x < cols; x++) d[x] = (sh[x] >= minV && sh[x] <= maxV) ? 255 : 0;
+                } else {
+                    const uchar* su = fuente->ptr<uchar>(y);
+                    for (int x = 0; x < cols; x++) d[x] = (su[x] >= minV && su[x] <= maxV) ? 255 : 0;
+                }
+            }
+
+            // 3.2 Pasos morfológicos: cada uno consume su radio del margen
+            int s0 = base, s1 = limite, margen = margenTotal;
+            for (int k = 0; k < numPasos; k++) {
+                margen -= radioElemento(pasos[k].elemento);
+                int f0 = std::max(0, y0 - margen), f1 = std::min(filas, y1 + margen);
+                if (pasos[k].dilatar)
+                    pasoMorfologico<OpMax>(pasos[k].elemento, a, bufH.data(), b, base, s0, s1, f0, f1, filas, cols);
+                else
+                    pasoMorfologico<OpMin>(pasos[k].elemento, a, bufH.data(), b, base, s0, s1, f0, f1, filas, cols);
+                std::swap(a, b);
+                s0 = f0; s1 = f1;
+            }
+
+            // 3.3 Máscara y overlay de las filas propias de la franja
+            for (int y = y0; y < y1; y++) {
+                const uchar* m = a + (y - base) * cols;
+                const uchar* g = procesada.ptr<uchar>(y);
+                uchar* dm = mascara.ptr<uchar>(y);
+                uchar* df = final.ptr<uchar>(y);
+                memcpy(dm, m, cols);
+                for (int x = 0; x < cols; x++) {
+                    uchar v = g[x];
+                    bool dentro = m[x] != 0;
+                    df[3 * x + 0] = dentro ? mezcla[0][v] : v;
+                    df[3 * x + 1] = dentro ? mezcla[1][v] : v;
+                    df[3 * x + 2] = dentro ? mezcla[2][v] : v;
+                }
+            }
+        }
+    });
+}
+
+std::vector<ResultadoPipeline> ImageProcessor::procesarLote(const std::vector<cv::Mat>& hu,
+                                                           const ConfiguracionPipeline& config,
+                                                           const std::vector<cv::Mat>& mascarasPrevias,
+                                                           const std::vector<cv::Mat>& procesadasPrevias) {
+    std::vector<ResultadoPipeline> res(hu.size());
+    std::vector<cv::Mat> contraste;
+    std::vector<size_t> pendientes;   // Cortes que sí necesitan la reducción de ruido
+    for (size_t i = 0; i < hu.size(); i++) {
+        res[i].hu = hu[i];
+        aplicarContrastStretching(hu[i], res[i].original);
+        if (i < procesadasPrevias.size() && !procesadasPrevias[i].empty()) {
+            res[i].procesada = procesadasPrevias[i];
+            continue;
+        }
+        cv::Mat c;
+        mejorarContraste(res[i].original, config.usarCLAHE, c);
+        contraste.push_back(c);
+        pendientes.push_back(i);
+    }
+
+    // La reducción de ruido va en lote: una sola pasada de la red para todos los cortes
+    if (!contraste.empty()) {
+        std::vector<cv::Mat> procesadas = aplicarReduccionRuidoLote(contraste, config.usarDNN, config.presetRuido);
+        for (size_t k = 0; k < pendientes.size(); k++) res[pendientes[k]].procesada = procesadas[k];
+    }
+
+    for (size_t i = 0; i < hu.size(); i++) {
+        cv::Mat previa = i < mascarasPrevias.size() ? mascarasPrevias[i] : cv::Mat();
+        segmentarYSuperponer(hu[i], res[i].procesada, config, previa, res[i].mascara, res[i].final);
+        trazarContornos(res[i].mascara, config, res[i].contornos, res[i].final);
+    }
+    return res;
+}
+
+ResultadoPipeline ImageProcessor::procesarCorte(cv::Mat hu, const ConfiguracionPipeline& config,
+                                                cv::Mat mascaraPrevia) {
+    ResultadoPipeline r;
+    r.hu = hu;
+    cv::Mat contraste;
+    aplicarContrastStretching(hu, r.original);
+    mejorarContraste(r.original, config.usarCLAHE, contraste);
+    aplicarReduccionRuido(contraste, config.usarDNN, config.presetRuido, r.procesada);
+    // Segmentación y resultado visual en una sola pasada
+    segmentarYSuperponer(hu, r.procesada, config, mascaraPrevia, r.mascara, r.final);
+    trazarContornos(r.mascara, config, r.contornos, r.final);
+    return r;
+}
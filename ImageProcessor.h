@@ -3,47 +3,215 @@
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/dnn.hpp>
+#include <memory>
+#include <string>
 #include <vector>
+#include "ContourExtractor.h"
+#include "ImageWorkspace.h"
+#include "InferencePool.h"
 
+// --- UMBRALES FÍSICOS (Unidades Hounsfield) ---
+// Al trabajar sobre HU reales los umbrales no dependen del min/max de cada corte.
+constexpr int HU_HUESO_MIN = 200;     // Hueso cortical y trabecular
+constexpr int HU_PULMON_MAX = -600;   // Aire / parénquima pulmonar
+constexpr int HU_TEJIDO_MIN = -100;   // Tejido blando (grasa .. músculo/órganos)
+constexpr int HU_TEJIDO_MAX = 100;
+constexpr int HU_AIRE = -1024;        // Valor mínimo habitual de un CT
+
+// --- PRESETS DE REDUCCIÓN DE RUIDO (calidad / velocidad) ---
+enum PresetRuido {
+    RUIDO_DNN = 0,        // DnCNN por teselas; sin modelo cae en NL-Means completo
+    RUIDO_NLM,            // NL-Means h=10, plantilla 7x7, búsqueda 21x21 (referencia, el más lento)
+    RUIDO_NLM_RAPIDO,     // NL-Means con ventana de búsqueda 11x11 (~4x menos comparaciones)
+    RUIDO_BILATERAL,      // Bilateral d=7: conserva bordes, muy rápido
+    RUIDO_GUIADO,         // Filtro guiado (autoguiado) con filtros de caja separables
+    NUM_PRESETS_RUIDO
+};
+
+// Parámetros del pipeline completo (compartidos por la GUI y el modo lote)
+struct ConfiguracionPipeline {
+    int modo = 0;          // 0:Manual, 1:Hueso, 2:Pulmon, 3:Tejido
+    bool usarCLAHE = false;
+    bool usarDNN = false;  // Activa la reducción de ruido (con el preset 'presetRuido')
+    int presetRuido = RUIDO_DNN;
+    bool usarMorf = true;
+    bool verBordes = false;   // Contornos vectoriales sobre el overlay (la máscara no cambia)
+    bool usar3D = false;   // Hueso/Pulmón desde la segmentación volumétrica (Segmenter3D)
+};
+
+// Opciones del pipeline en la línea de comandos (modo lote y peticiones al servidor):
+// --mode manual|hueso|pulmon|tejido, --clahe, --dnn, --filtro <preset>, --sin-morf, --bordes, --3d.
+// Devuelve true si args[i] es una de ellas (avanza 'i' si lleva valor); con un valor
+// no reconocido deja el motivo en 'error'.
+bool leerOpcionPipeline(const std::vector<std::string>& args, size_t& i, ConfiguracionPipeline& config,
+                        std::string& error);
+
+// Las 4 vistas que produce el pipeline para un corte
+struct ResultadoPipeline {
+    cv::Mat hu;          // Corte original en Unidades Hounsfield (CV_16S)
+    cv::Mat original;    // Corte original con ventana aplicada (8 bits, para mostrar/guardar)
+    cv::Mat procesada;
+    cv::Mat mascara;
+    cv::Mat final;
+    ContornosCorte contornos;   // Contornos de la máscara (solo con VER BORDES)
+};
+
+// Cada función de procesamiento tiene dos formas: la que devuelve un cv::Mat nuevo y la
+// de parámetro de salida, que reutiliza la memoria de 'salida' si ya tiene el tamaño y tipo
+// correctos. Los intermedios salen del espacio de trabajo (ImageWorkspace).
+//
+// Hilos: una instancia guarda buffers, LUT y blobs propios, así que cada hilo usa la suya.
+// Varias instancias pueden trabajar a la vez: no hay estado global (ni el nivel de log ni
+// los hilos de OpenCV se tocan aquí), las entradas no se modifican y la red se comparte
+// con InferencePool, que presta a cada hilo una instancia de cv::dnn::Net distinta.
 class ImageProcessor {
 public:
     void cargarRedNeuronal(const std::string& rutaModelo);
+    // Usa un pool de redes ya cargado (p. ej. el mismo para todos los hilos de un lote)
+    void compartirRed(std::shared_ptr<InferencePool> pool);
+    std::shared_ptr<InferencePool> red() const { return redes; }
+    // El modelo está cargado y no ha rechazado las teselas (si no, se usa el respaldo)
+    bool redDisponible() const { return redes && !redFallida; }
+    // Preset que de verdad se aplica: sin modelo, DnCNN cae en NL-Means
+    int presetEfectivo(int preset) const { return (preset == RUIDO_DNN && !redDisponible()) ? RUIDO_NLM : preset; }
+    // Todo lo que, además del preset y CLAHE, cambia la salida del filtro de ruido: la
+    // ventana HU y, con la red, los bytes del modelo y las teselas. Clave de las cachés en disco.
+    uint64_t huellaFiltro(int preset) const;
+
+    // Buffers, elementos estructurantes, CLAHE y contador de reservas
+    ImageWorkspace& espacioTrabajo() { return espacio; }
 
     // 1. Ecualización de Histograma (Estándar vs CLAHE - Técnica Nueva)
     cv::Mat mejorarContraste(cv::Mat entrada, bool usarCLAHE);
+    void mejorarContraste(const cv::Mat& entrada, bool usarCLAHE, cv::Mat& salida);
 
     // 2. Denoising (Suavizado e IA)
-    cv::Mat aplicarReduccionRuido(cv::Mat entrada, bool usarDNN);
+    cv::Mat aplicarReduccionRuido(cv::Mat entrada, bool usarDNN, int preset = RUIDO_DNN);
+    // Sin reducción de ruido copia sobre 'salida'; los filtros y la red reservan internamente
+    void aplicarReduccionRuido(const cv::Mat& entrada, bool usarDNN, int preset, cv::Mat& salida);
+
+    // Denoising en lote: con RUIDO_DNN las imágenes se cortan en teselas solapadas del
+    // tamaño de entrada del modelo, que pasan por la red en lotes NCHW de 'tamLote'
+    // teselas (los blobs se reutilizan entre llamadas) y se mezclan con una ventana de Hann
+    std::vector<cv::Mat> aplicarReduccionRuidoLote(const std::vector<cv::Mat>& entradas, bool usarDNN,
+                                                   int preset = RUIDO_DNN);
+
+    // Filtro clásico de un preset (8 bits), en franjas de filas repartidas entre los núcleos
+    cv::Mat filtrarRuido(const cv::Mat& entrada, int preset);
+
+    // Latencia por corte (ms, media móvil) medida para cada preset; 0 si aún no se usó
+    double latenciaRuido(int preset) const;
+    static const char* nombrePresetRuido(int preset);
+
+    // Teselas por pasada de la red (los hilos de OpenCV los fija la aplicación)
+    void configurarInferencia(int tamLote);
+
+    // Tamaño de tesela (= entrada del modelo, 224 en dncnn.onnx) y solape entre teselas.
+    // La salida puede ser de otro tamaño (dncnn.onnx es ESPCN x3): se reduce a la tesela
+    void configurarTeselas(int tam, int solape);
 
     // 3. Detección de Bordes (Canny)
     cv::Mat detectarBordes(cv::Mat entrada, double umbralBajo, double umbralAlto);
 
     // --- PRESETS MÉDICOS (Para cumplir "3 zonas de interés") ---
-    cv::Mat segmentarHueso(cv::Mat entrada);       // Zona 1
-    cv::Mat segmentarPulmon(cv::Mat entrada);      // Zona 2
-    cv::Mat segmentarTejidoBlando(cv::Mat entrada);// Zona 3
+    // Reciben el corte en Unidades Hounsfield (CV_16S)
+    cv::Mat segmentarHueso(cv::Mat hu);       // Zona 1
+    cv::Mat segmentarPulmon(cv::Mat hu);      // Zona 2
+    cv::Mat segmentarTejidoBlando(cv::Mat hu);// Zona 3
+    void segmentarHueso(const cv::Mat& hu, cv::Mat& mascara);
+    void segmentarPulmon(const cv::Mat& hu, cv::Mat& mascara);
+    void segmentarTejidoBlando(const cv::Mat& hu, cv::Mat& mascara);
+
+    // Umbral por rango de HU (sin limpieza morfológica)
+    cv::Mat umbralizarHU(cv::Mat hu, int minHU, int maxHU);
+    void umbralizarHU(const cv::Mat& hu, int minHU, int maxHU, cv::Mat& mascara);
 
     // Auxiliar: Overlay para visualización
     cv::Mat crearOverlay(cv::Mat original, cv::Mat mascara, cv::Scalar color);
+    void crearOverlay(const cv::Mat& original, const cv::Mat& mascara, cv::Scalar color, cv::Mat& resultado);
 
     // Agregar en public:
     cv::Mat aplicarGradienteMorfologico(cv::Mat mascara);
+    void aplicarGradienteMorfologico(const cv::Mat& mascara, cv::Mat& salida);
     
     // En ImageProcessor.h (dentro de public:)
     cv::Mat aplicarApertura(cv::Mat mascara); // Para quitar ruido
+    void aplicarApertura(const cv::Mat& mascara, cv::Mat& salida);
 
     // CUMPLE: Contrast Stretching (Estiramiento de contraste lineal)
+    // Si la entrada es CV_16S (HU) se aplica la ventana configurada con una LUT.
     cv::Mat aplicarContrastStretching(cv::Mat entrada);
+    void aplicarContrastStretching(const cv::Mat& entrada, cv::Mat& salida);
+
+    // Ventana de visualización HU -> 8 bits (clamp + escala + conversión en una sola LUT)
+    cv::Mat aplicarVentanaHU(cv::Mat hu, int minHU, int maxHU);
+    void aplicarVentanaHU(const cv::Mat& hu, int minHU, int maxHU, cv::Mat& salida);
+    void setVentanaHU(int minHU, int maxHU);
     
     // CUMPLE: Guardar imágenes en disco
     void guardarResultados(const std::string& nombreBase, cv::Mat orig, cv::Mat proc, cv::Mat mask, cv::Mat final);
 
+    // --- PIPELINE COMPLETO (Stretching -> CLAHE -> Ruido -> Segmentación -> Overlay) ---
+    cv::Mat preprocesar(cv::Mat entrada, bool usarCLAHE, bool usarDNN);
+    // 'mascaraPrevia' (opcional) sustituye al umbral 2D, p.ej. el corte de una máscara 3D
+    cv::Mat segmentarSegunModo(cv::Mat hu, cv::Mat procesada, const ConfiguracionPipeline& config,
+                               cv::Mat mascaraPrevia = cv::Mat());
+    void segmentarSegunModo(const cv::Mat& hu, const cv::Mat& procesada, const ConfiguracionPipeline& config,
+                            const cv::Mat& mascaraPrevia, cv::Mat& mascara);
+    cv::Scalar colorModo(int modo);
+    static const char* nombreModo(int modo);
+
+    // Kernel fusionado: umbral HU + morfología 3x3/5x5 + overlay BGR en una sola pasada
+    // por franjas de filas (mismo resultado que segmentarSegunModo + crearOverlay).
+    // 'mascara' y 'final' se reutilizan si ya tienen el tamaño correcto.
+    void segmentarYSuperponer(const cv::Mat& hu, const cv::Mat& procesada, const ConfiguracionPipeline& config,
+                              const cv::Mat& mascaraPrevia, cv::Mat& mascara, cv::Mat& final);
+    // VER BORDES: contornos vectoriales de la máscara, dibujados sobre 'final' (sin VER BORDES
+    // solo vacía 'contornos')
+    void trazarContornos(const cv::Mat& mascara, const ConfiguracionPipeline& config,
+                         ContornosCorte& contornos, cv::Mat& final);
+    ResultadoPipeline procesarCorte(cv::Mat hu, const ConfiguracionPipeline& config,
+                                    cv::Mat mascaraPrevia = cv::Mat());
+    // Igual que procesarCorte, pero con la reducción de ruido en lote.
+    // 'procesadasPrevias' (opcional): cortes ya filtrados (p. ej. de la caché de volumen);
+    // los que no estén vacíos no vuelven a pasar por la reducción de ruido.
+    std::vector<ResultadoPipeline> procesarLote(const std::vector<cv::Mat>& hu, const ConfiguracionPipeline& config,
+                                                const std::vector<cv::Mat>& mascarasPrevias,
+                                                const std::vector<cv::Mat>& procesadasPrevias = std::vector<cv::Mat>());
+
 private:
-    cv::dnn::Net redNeuronal;
-    bool redCargada = false;
+    ImageWorkspace espacio;
+    ContourExtractor extractorContornos;
+
+    std::shared_ptr<InferencePool> redes;
+
+    // Inferencia por teselas en lote: blobs preasignados y ventana de mezcla
+    int tamLote = 8;
+    int tamTesela = 224;
+    int solapeTesela = 32;
+    bool redFallida = false;   // La red no aceptó las teselas: se avisó y se usa el respaldo
+    cv::Mat blobEntrada;
+    cv::Mat blobSalida;
+    cv::Mat teselaReducida;    // Salida de la red devuelta a T x T si el modelo cambia la escala
+    cv::Mat ventanaMezcla;
+    bool inferirPorTeselas(const std::vector<cv::Mat>& entradas, std::vector<cv::Mat>& salidas);
+
+    // Latencia media por corte de cada preset de ruido
+    double latenciaMs[NUM_PRESETS_RUIDO] = {0};
+    void registrarLatencia(int preset, int64 ticks, size_t cortes);
+
+    // Ventana de visualización por defecto (cubre de pulmón a hueso)
+    int ventanaMinHU = -1000;
+    int ventanaMaxHU = 1000;
+
+    // LUT de 65536 entradas (una por valor signed short) de la última ventana usada
+    std::vector<uchar> lutVentana;
+    int lutMinHU = 0;
+    int lutMaxHU = 0;
     
-    // Función interna para limpieza morfológica
-    cv::Mat limpiarMascara(cv::Mat mascara, int tipoMorfologico);
+    // Función interna para limpieza morfológica (no modifica 'mascara')
+    cv::Mat limpiarMascara(const cv::Mat& mascara, int tipoMorfologico);
+    void limpiarMascara(const cv::Mat& mascara, int tipoMorfologico, cv::Mat& salida);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "ImageWorkspace.h"
+
+cv::Mat& ImageWorkspace::buffer(int id, cv::Size tam, int tipo) {
+    cv::Mat& m = buffers[std::make_tuple(id, tam.height, tam.width, tipo)];
+    if (m.empty()) {
+        m.create(tam, tipo);
+        numReservas++;
+    }
+    return m;
+}
+
+void ImageWorkspace::preparar(cv::Mat& salida, cv::Size tam, int tipo) {
+    const uchar* antes = salida.datastart;
+    salida.create(tam, tipo);
+    if (salida.datastart != antes) numReservas++;
+}
+
+const cv::Mat& ImageWorkspace::elemento(int forma, int tam) {
+    cv::Mat& e = elementos[std::make_pair(forma, tam)];
+    if (e.empty()) {
+        e = cv::getStructuringElement(forma, cv::Size(tam, tam));
+        numReservas++;
+    }
+    return e;
+}
+
+cv::Ptr<cv::CLAHE> ImageWorkspace::clahe() {
+    if (!claheCache) {
+        claheCache = cv::createCLAHE(2.0, cv::Size(8, 8));
+        numReservas++;
+    }
+    return claheCache;
+}
+
+void ImageWorkspace::liberar() {
+    buffers.clear();
+    elementos.clear();
+    claheCache.release();
+}
@@ -0,0 +1,41 @@
+#ifndef IMAGEWORKSPACE_H
+#define IMAGEWORKSPACE_H
+
+#include <map>
+#include <tuple>
+#include <utility>
+#include <opencv2/opencv.hpp>
+
+// Espacio de trabajo de ImageProcessor: buffers intermedios reservados una sola vez
+// (indexados por identificador, tamaño y tipo), elementos estructurantes en caché y
+// una instancia persistente de CLAHE. Junto con la API de parámetros de salida de
+// ImageProcessor, un fotograma del mismo tamaño que el anterior no reserva memoria.
+class ImageWorkspace {
+public:
+    // Buffer intermedio 'id' del tamaño y tipo pedidos (se reserva solo la primera vez)
+    cv::Mat& buffer(int id, cv::Size tam, int tipo);
+
+    // Prepara una salida del llamador: solo reserva si cambia el tamaño o el tipo
+    void preparar(cv::Mat& salida, cv::Size tam, int tipo);
+
+    // Elemento estructurante (cv::MORPH_RECT / MORPH_ELLIPSE / MORPH_CROSS) de tam x tam
+    const cv::Mat& elemento(int forma, int tam);
+
+    // CLAHE (clipLimit 2.0, rejilla 8x8) creado una vez y reutilizado
+    cv::Ptr<cv::CLAHE> clahe();
+
+    // Contador de depuración: reservas de memoria hechas a través del espacio de trabajo
+    size_t reservas() const { return numReservas; }
+    void reiniciarContador() { numReservas = 0; }
+
+    // Libera todos los buffers (p.ej. al cambiar de serie)
+    void liberar();
+
+private:
+    std::map<std::tuple<int, int, int, int>, cv::Mat> buffers;   // (id, filas, columnas, tipo)
+    std::map<std::pair<int, int>, cv::Mat> elementos;            // (forma, tam)
+    cv::Ptr<cv::CLAHE> claheCache;
+    size_t numReservas = 0;
+};
+
+#endif
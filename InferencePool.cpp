@@ -0,0 +1,76 @@
+#include "InferencePool.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+std::shared_ptr<InferencePool> InferencePool::cargar(const std::string& rutaModelo, int maxInstancias) {
+    // 1. El archivo se lee una vez; sin modelo no hay nada que registrar en el log de OpenCV
+    std::ifstream f(rutaModelo, std::ios::binary);
+    if (!f) return nullptr;
+    std::vector<uchar> modelo((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    if (modelo.empty()) return nullptr;
+
+    if (maxInstancias <= 0) maxInstancias = std::max(1, (int)std::thread::hardware_concurrency());
+    std::shared_ptr<InferencePool> pool(new InferencePool(std::move(modelo), maxInstancias));
+
+    // 2. Primera instancia: valida el modelo y queda libre para el primer hilo
+    cv::dnn::Net red;
+    if (!pool->crearInstancia(red)) return nullptr;
+    pool->libres.push_back(red);
+    pool->creadas = 1;
+    return pool;
+}
+
+InferencePool::InferencePool(std::vector<uchar> modelo, int maxInstancias)
+    : modelo(std::move(modelo)), maxInstancias(maxInstancias) {
+    huellaModelo = 14695981039346656037ULL;   // Base FNV-1a
+    for (uchar b : this->modelo) {
+        huellaModelo ^= b;
+        huellaModelo *= 1099511628211ULL;
+    }
+}
+
+bool InferencePool::crearInstancia(cv::dnn::Net& red) const {
+    try {
+        red = cv::dnn::readNetFromONNX(modelo);
+        // Configuración para CPU (más compatible)
+        red.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+        red.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    } catch (cv::Exception&) {
+        return false;
+    }
+    return !red.empty();
+}
+
+InferencePool::Prestamo InferencePool::tomar() {
+    std::unique_lock<std::mutex> lock(mtx);
+    // 1. Una instancia libre
+    if (libres.empty() && creadas < maxInstancias) {
+        // 2. Ninguna libre y aún hay cupo: se crea fuera del candado (interpretar el ONNX tarda)
+        creadas++;
+        lock.unlock();
+        cv::dnn::Net nueva;
+        if (crearInstancia(nueva)) return Prestamo(this, nueva);
+        lock.lock();
+        creadas--;
+    }
+    // 3. Cupo agotado: esperar a que otro hilo devuelva la suya
+    hayLibre.wait(lock, [this] { return !libres.empty(); });
+    cv::dnn::Net red = libres.back();
+    libres.pop_back();
+    return Prestamo(this, red);
+}
+
+void InferencePool::devolver(const cv::dnn::Net& red) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        libres.push_back(red);
+    }
+    hayLibre.notify_one();
+}
+
+int InferencePool::instancias() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return creadas;
+}
@@ -0,0 +1,68 @@
+#ifndef INFERENCEPOOL_H
+#define INFERENCEPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/dnn.hpp>
+
+// Instancias de la red DnCNN compartidas entre hilos.
+//
+// cv::dnn::Net::forward() no admite dos llamadas a la vez sobre la misma instancia
+// (guarda los blobs intermedios dentro de la red). El modelo ONNX se lee de disco una
+// sola vez; cada hilo toma prestada una instancia libre y la devuelve al terminar. Si no
+// hay ninguna libre se crea otra desde el modelo en memoria, hasta 'maxInstancias'; por
+// encima de ese número el hilo espera a que otro la devuelva.
+class InferencePool {
+public:
+    // Lee el modelo y crea la primera instancia. Devuelve nullptr si el archivo no
+    // existe o OpenCV no lo puede interpretar. 'maxInstancias' <= 0: una por núcleo.
+    static std::shared_ptr<InferencePool> cargar(const std::string& rutaModelo, int maxInstancias = 0);
+
+    // Instancia prestada: vuelve al pool al destruirse
+    class Prestamo {
+    public:
+        Prestamo(InferencePool* pool, cv::dnn::Net red) : pool(pool), instancia(red) {}
+        Prestamo(Prestamo&& otro) : pool(otro.pool), instancia(otro.instancia) { otro.pool = nullptr; }
+        Prestamo(const Prestamo&) = delete;
+        Prestamo& operator=(const Prestamo&) = delete;
+        ~Prestamo() { if (pool) pool->devolver(instancia); }
+
+        cv::dnn::Net& red() { return instancia; }
+
+    private:
+        InferencePool* pool;
+        cv::dnn::Net instancia;
+    };
+
+    Prestamo tomar();
+
+    // La red rechazó la entrada: devuelve true solo la primera vez (para avisar una vez)
+    bool marcarFallida() { return !fallida.exchange(true); }
+
+    int instancias() const;
+    // FNV-1a de los bytes del modelo: distingue los resultados de modelos distintos en las cachés
+    uint64_t huella() const { return huellaModelo; }
+
+private:
+    InferencePool(std::vector<uchar> modelo, int maxInstancias);
+    void devolver(const cv::dnn::Net& red);
+    bool crearInstancia(cv::dnn::Net& red) const;
+
+    std::vector<uchar> modelo;   // ONNX en memoria (solo lectura tras cargar)
+    uint64_t huellaModelo = 0;
+    int maxInstancias;
+
+    mutable std::mutex mtx;
+    std::condition_variable hayLibre;
+    std::vector<cv::dnn::Net> libres;
+    int creadas = 0;
+
+    std::atomic<bool> fallida{false};
+};
+
+#endif
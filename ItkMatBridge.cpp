@@ -0,0 +1,44 @@
+#include "ItkMatBridge.h"
+
+// Asignador de OpenCV para buffers ajenos: no reserva memoria propia, solo
+// suelta la referencia al dueño externo cuando el contador de la Mat llega a 0.
+class AsignadorExterno : public cv::MatAllocator {
+public:
+    // Si una Mat envuelta se redimensiona con create(), la nueva memoria
+    // la gestiona el asignador estándar (u->currAllocator queda apuntando a él).
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData* u, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override {
+        return cv::Mat::getStdAllocator()->allocate(u, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* u) const override {
+        if (!u) return;
+        CV_Assert(u->urefcount == 0 && u->refcount == 0);
+        delete static_cast<std::shared_ptr<void>*>(u->userdata);
+        delete u;
+    }
+};
+
+static AsignadorExterno& asignadorExterno() {
+    static AsignadorExterno instancia;
+    return instancia;
+}
+
+cv::Mat envolverBuffer(void* datos, int filas, int columnas, int tipo,
+                       std::shared_ptr<void> dueno, size_t paso) {
+    cv::Mat m(filas, columnas, tipo, datos, paso);
+
+    cv::UMatData* u = new cv::UMatData(&asignadorExterno());
+    u->data = u->origdata = static_cast<uchar*>(datos);
+    u->size = m.step[0] * (size_t)filas;
+    u->userdata = new std::shared_ptr<void>(std::move(dueno));
+    u->refcount = 1;
+
+    m.u = u;
+    m.allocator = &asignadorExterno();
+    return m;
+}
@@ -0,0 +1,32 @@
+#ifndef ITKMATBRIDGE_H
+#define ITKMATBRIDGE_H
+
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+// Puente sin copia entre buffers externos (ITK, mmap, ...) y cv::Mat.
+// La cv::Mat devuelta apunta directamente al buffer; 'dueno' lo mantiene vivo
+// hasta que se libera la última cv::Mat (o ROI) que lo referencia.
+cv::Mat envolverBuffer(void* datos, int filas, int columnas, int tipo,
+                       std::shared_ptr<void> dueno, size_t paso = cv::Mat::AUTO_STEP);
+
+// Envuelve el buffer de una itk::Image sin copiarlo. La Mat conserva una
+// referencia al SmartPointer, así que la imagen ITK vive lo mismo que la Mat.
+// Para imágenes N-D las filas de todos los cortes se apilan: (Y*Z*...) x X.
+template <typename TImagen>
+cv::Mat envolverImagenITK(const typename TImagen::Pointer& img, int tipo) {
+    typename TImagen::SizeType size = img->GetBufferedRegion().GetSize();
+    int filas = 1;
+    for (unsigned int d = 1; d < TImagen::ImageDimension; d++) filas *= (int)size[d];
+
+    // Desconectar del lector para que un nuevo Update() no reutilice el buffer
+    img->DisconnectPipeline();
+
+    auto* ref = new typename TImagen::Pointer(img);
+    std::shared_ptr<void> dueno(ref, [](void* p) {
+        delete static_cast<typename TImagen::Pointer*>(p);
+    });
+    return envolverBuffer(img->GetBufferPointer(), filas, (int)size[0], tipo, dueno);
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef MPRREFORMATTER_H
+#define MPRREFORMATTER_H
+
+#include <opencv2/opencv.hpp>
+#include "DicomHandler.h"
+#include "SliceStore.h"
+
+// Reconstrucción multiplanar (MPR): vistas coronal y sagital generadas desde el volumen.
+//
+// - Coronal (fila y): la fila y de cada corte axial ya es contigua en memoria.
+// - Sagital (columna x): leer una columna salta 'ancho' píxeles por fila. Por eso se
+//   guarda una vez una copia traspuesta de cada corte (trasposición por bloques que
+//   caben en L1), y la columna x pasa a ser la fila x de esa copia.
+//
+// El eje z se remuestrea con interpolación lineal (punto fijo, bucle vectorizable) para
+// que el píxel salga cuadrado: con cortes de 3 mm y 0.7 mm por píxel, cada corte ocupa ~4 filas.
+//
+// Con la serie comprimida (SliceStore) no hay volumen descomprimido: la copia traspuesta
+// se rellena descomprimiendo corte a corte y es la única copia. El coronal sale entonces
+// de sus columnas (lectura con salto, algo más lenta que la fila contigua).
+class MprReformatter {
+public:
+    // Asocia el volumen y prepara la copia traspuesta (en paralelo, por cortes)
+    void asignarVolumen(const VolumenCT& volumen);
+    // Igual, desde los cortes comprimidos; 'geometria' aporta el espaciado (sus datos pueden estar vacíos)
+    void asignarAlmacen(const SliceStore& almacen, const VolumenCT& geometria);
+    // Suelta la copia traspuesta (y la referencia al volumen)
+    void liberar();
+    bool listo() const { return !traspuesto.empty(); }
+
+    // Vistas en HU (CV_16S): filasSalida() x ancho (coronal) y filasSalida() x alto (sagital)
+    void coronal(int y, cv::Mat& salida) const;
+    void sagital(int x, cv::Mat& salida) const;
+
+    // Conversión entre filas de las vistas remuestreadas e índices de corte
+    int filasSalida() const { return filas; }
+    int corteDeFila(int fila) const;
+    int filaDeCorte(int z) const;
+
+private:
+    // Rellena 'salida' interpolando en z las filas 'fila' de cada corte de 'pila'
+    // (pila apilada como VolumenCT: numCortes bloques de 'altoBloque' filas)
+    void reformatear(const cv::Mat& pila, int altoBloque, int fila, cv::Mat& salida) const;
+    // Igual con la columna 'columna' de cada bloque (coronal desde la copia traspuesta)
+    void reformatearColumna(const cv::Mat& pila, int altoBloque, int columna, cv::Mat& salida) const;
+    void calcularEscalaZ();
+
+    VolumenCT vol;          // Sin datos si se asignó desde un SliceStore
+    cv::Mat traspuesto;     // (numCortes*ancho) x alto: cada corte traspuesto
+    int filas = 0;          // Filas de las vistas tras remuestrear z
+    double escalaZ = 1.0;   // Filas de salida por corte
+};
+
+#endif
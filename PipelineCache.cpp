@@ -0,0 +1,91 @@
+#include "PipelineCache.h"
+#include "VolumeCache.h"
+
+PipelineCache::PipelineCache(ImageProcessor& proc, size_t maxCortesDenoise)
+    : proc(proc), maxCortesDenoise(maxCortesDenoise) {}
+
+void PipelineCache::invalidar() {
+    ventanaIndice = -1;
+    contrasteValido = false;
+    denoiseValido = false;
+    mascaraValida = false;
+    cacheDenoise.clear();
+}
+
+bool PipelineCache::actualizar(int indice, const cv::Mat& hu, const ConfiguracionPipeline& config,
+                               const cv::Mat& mascaraPrevia) {
+    ClaveDenoise kDenoise{indice, config.usarCLAHE, config.usarDNN, config.presetRuido};
+    ClaveMascara kMascara{kDenoise, config.modo, config.usarMorf, config.verBordes, !mascaraPrevia.empty()};
+
+    // Nada cambió: el fotograma anterior sigue siendo válido
+    if (mascaraValida && kMascara == claveMascara) return false;
+
+    // --- ETAPA 0: VENTANA HU -> 8 BITS (solo al cambiar de corte) ---
+    if (ventanaIndice != indice) {
+        res.hu = hu;
+        proc.aplicarContrastStretching(hu, res.original);
+        ventanaIndice = indice;
+        vers.original++;
+        contrasteValido = false;
+    }
+
+    // --- ETAPA 2: REDUCCIÓN DE RUIDO (con caché por corte) ---
+    if (!denoiseValido || !(kDenoise == claveDenoise)) {
+        auto it = cacheDenoise.begin();
+        for (; it != cacheDenoise.end(); ++it) {
+            if (it->first == kDenoise) break;
+        }
+
+        if (it != cacheDenoise.end()) {
+            cacheDenoise.splice(cacheDenoise.begin(), cacheDenoise, it);
+        } else {
+            // Con la caché llena se reutiliza la memoria de la entrada menos usada
+            cv::Mat destino;
+            if (cacheDenoise.size() >= maxCortesDenoise) {
+                destino = cacheDenoise.back().second;
+                cacheDenoise.pop_back();
+            }
+
+            // Corte ya filtrado en una sesión anterior: se copia desde el mmap
+            cv::Mat enDisco;
+            if (cacheVolumen && config.usarDNN) {
+                enDisco = cacheVolumen->corteFiltrado(indice, proc.presetEfectivo(config.presetRuido), config.usarCLAHE,
+                                                      proc.huellaFiltro(config.presetRuido));
+            }
+
+            if (!enDisco.empty()) {
+                enDisco.copyTo(destino);
+            } else {
+                // --- ETAPA 1: CLAHE ---
+                if (!contrasteValido || contrasteCLAHE != config.usarCLAHE) {
+                    proc.mejorarContraste(res.original, config.usarCLAHE, contraste);
+                    contrasteCLAHE = config.usarCLAHE;
+                    contrasteValido = true;
+                }
+                proc.aplicarReduccionRuido(contraste, config.usarDNN, config.presetRuido, destino);
+                if (cacheVolumen && config.usarDNN) {
+                    // Tras un fallo de la red el resultado es del respaldo: se guarda con su preset
+                    cacheVolumen->guardarFiltrado(indice, proc.presetEfectivo(config.presetRuido), config.usarCLAHE,
+                                                  proc.huellaFiltro(config.presetRuido), destino);
+                }
+            }
+            cacheDenoise.emplace_front(kDenoise, destino);
+        }
+
+        res.procesada = cacheDenoise.front().second;
+        vers.procesada++;
+        claveDenoise = kDenoise;
+        denoiseValido = true;
+    }
+
+    // --- ETAPA 3 y 4: SEGMENTACIÓN (HU) + OVERLAY ---
+    // Kernel fusionado: reutiliza los buffers de la máscara y el overlay del fotograma anterior
+    proc.segmentarYSuperponer(res.hu, res.procesada, config, mascaraPrevia, res.mascara, res.final);
+    // Los contornos se guardan con la máscara: solo se vuelven a extraer cuando ella cambia
+    proc.trazarContornos(res.mascara, config, res.contornos, res.final);
+    vers.mascara++;
+    vers.final++;
+    claveMascara = kMascara;
+    mascaraValida = true;
+    return true;
+}
@@ -0,0 +1,97 @@
+#ifndef PIPELINECACHE_H
+#define PIPELINECACHE_H
+
+#include <cstdint>
+#include <list>
+#include <opencv2/opencv.hpp>
+#include "ImageProcessor.h"
+
+class VolumeCache;
+
+// Contadores que avanzan cada vez que se recalcula una salida del pipeline.
+// Los buffers se reutilizan entre fotogramas, así que el puntero de datos no sirve
+// para saber si una vista cambió: la GUI compara estas versiones.
+struct VersionesPipeline {
+    uint64_t original = 0;
+    uint64_t procesada = 0;
+    uint64_t mascara = 0;
+    uint64_t final = 0;
+};
+
+// Grafo del pipeline con seguimiento de cambios ("dirty tracking").
+// Cada etapa guarda la clave de las entradas con las que se calculó y solo se
+// vuelve a ejecutar cuando esa clave cambia:
+//
+//   hu --(indice)--> ventana 8 bits --(CLAHE)--> contraste --(+DNN, preset)--> denoise --(+modo, morf, bordes)--> mascara --> overlay
+//
+// La salida de la reducción de ruido (la etapa cara: DnCNN o el filtro clásico del preset) además se
+// guarda por corte, para que volver a un corte ya visto no la recalcule; con caché de volumen
+// también se guarda en disco y sobrevive entre sesiones.
+class PipelineCache {
+public:
+    explicit PipelineCache(ImageProcessor& proc, size_t maxCortesDenoise = 64);
+
+    // Ejecuta solo las etapas afectadas. Devuelve true si cambió algún resultado.
+    // 'hu' es el corte original en Unidades Hounsfield (CV_16S).
+    // 'mascaraPrevia' (opcional) es el corte de una máscara 3D ya calculada.
+    bool actualizar(int indice, const cv::Mat& hu, const ConfiguracionPipeline& config,
+                    const cv::Mat& mascaraPrevia = cv::Mat());
+
+    const ResultadoPipeline& resultado() const { return res; }
+    const VersionesPipeline& versiones() const { return vers; }
+
+    // Fuerza el recálculo completo en la próxima actualización
+    void invalidar();
+
+    // Segundo nivel para la reducción de ruido: las capas de la caché de volumen en disco.
+    // Solo tiene sentido si 'indice' es el corte del volumen abierto con esa caché.
+    void usarCacheVolumen(VolumeCache* cache) { cacheVolumen = cache; }
+
+private:
+    struct ClaveDenoise {
+        int indice;
+        bool usarCLAHE;
+        bool usarDNN;
+        int presetRuido;
+        bool operator==(const ClaveDenoise& o) const {
+            return indice == o.indice && usarCLAHE == o.usarCLAHE && usarDNN == o.usarDNN
+                && presetRuido == o.presetRuido;
+        }
+    };
+    struct ClaveMascara {
+        ClaveDenoise base;
+        int modo;
+        bool usarMorf;
+        bool verBordes;
+        bool usar3D;
+        bool operator==(const ClaveMascara& o) const {
+            return base == o.base && modo == o.modo && usarMorf == o.usarMorf
+                && verBordes == o.verBordes && usar3D == o.usar3D;
+        }
+    };
+
+    ImageProcessor& proc;
+    ResultadoPipeline res;
+    VersionesPipeline vers;
+
+    // Etapa 0: Ventana HU -> 8 bits del corte actual
+    int ventanaIndice = -1;
+
+    // Etapa 1: CLAHE sobre la ventana del corte actual (un solo slot)
+    bool contrasteValido = false;
+    bool contrasteCLAHE = false;
+    cv::Mat contraste;
+
+    // Etapa 2: Reducción de ruido (LRU por corte)
+    std::list<std::pair<ClaveDenoise, cv::Mat>> cacheDenoise;
+    size_t maxCortesDenoise;
+    VolumeCache* cacheVolumen = nullptr;
+    bool denoiseValido = false;
+    ClaveDenoise claveDenoise{-1, false, false, 0};
+
+    // Etapa 3 y 4: Máscara y Overlay
+    bool mascaraValida = false;
+    ClaveMascara claveMascara{{-1, false, false, 0}, 0, false, false, false};
+};
+
+#endif
@@ -0,0 +1,444 @@
+#include "ProcessingServer.h"
+#include "DicomHandler.h"
+#include "Segmenter3D.h"
+#include "VolumeCache.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t MB = 1024 * 1024;
+// Volumen 3D: máscara (1) + etiquetas de componentes conexas (4) por vóxel
+const size_t BYTES_VOXEL_3D = 5;
+
+// SIGINT/SIGTERM: el manejador solo marca la señal y despierta a accept()
+// (shutdown() se puede llamar desde un manejador de señales)
+volatile std::sig_atomic_t senalRecibida = 0;
+volatile int fdEscuchaSenal = -1;
+
+void manejarSenal(int) {
+    senalRecibida = 1;
+    if (fdEscuchaSenal >= 0) shutdown(fdEscuchaSenal, SHUT_RDWR);
+}
+
+bool enviarTodo(int fd, const std::string& datos) {
+    size_t enviado = 0;
+    while (enviado < datos.size()) {
+        ssize_t n = send(fd, datos.data() + enviado, datos.size() - enviado, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        enviado += (size_t)n;
+    }
+    return true;
+}
+
+// Lee hasta el siguiente '\n'; 'pendiente' guarda lo que llegó de más entre llamadas
+bool leerLinea(int fd, std::string& pendiente, std::string& linea) {
+    size_t fin;
+    char buf[4096];
+    while ((fin = pendiente.find('\n')) == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        pendiente.append(buf, (size_t)n);
+        if (pendiente.size() > 64 * 1024) return false;   // Una petición no ocupa tanto
+    }
+    linea = pendiente.substr(0, fin);
+    pendiente.erase(0, fin + 1);
+    if (!linea.empty() && linea.back() == '\r') linea.pop_back();
+    return true;
+}
+
+// Separa por espacios; las comillas dobles permiten rutas con espacios
+std::vector<std::string> tokenizar(const std::string& linea) {
+    std::vector<std::string> tokens;
+    std::string actual;
+    bool comillas = false, hayToken = false;
+    for (char c : linea) {
+        if (c == '"') { comillas = !comillas; hayToken = true; }
+        else if ((c == ' ' || c == '\t') && !comillas) {
+            if (hayToken) tokens.push_back(actual);
+            actual.clear();
+            hayToken = false;
+        } else {
+            actual += c;
+            hayToken = true;
+        }
+    }
+    if (hayToken) tokens.push_back(actual);
+    return tokens;
+}
+
+bool abrirSocket(const std::string& ruta, sockaddr_un& dir) {
+    if (ruta.size() >= sizeof(dir.sun_path)) return false;
+    std::memset(&dir, 0, sizeof(dir));
+    dir.sun_family = AF_UNIX;
+    std::strncpy(dir.sun_path, ruta.c_str(), sizeof(dir.sun_path) - 1);
+    return true;
+}
+
+// Solo se agrupan en un lote cortes que pasan por exactamente el mismo pipeline
+bool mismaConfiguracion(const ConfiguracionPipeline& a, const ConfiguracionPipeline& b) {
+    return a.modo == b.modo && a.usarCLAHE == b.usarCLAHE && a.usarDNN == b.usarDNN
+        && a.presetRuido == b.presetRuido && a.usarMorf == b.usarMorf && a.verBordes == b.verBordes
+        && a.usar3D == b.usar3D;
+}
+
+} // namespace
+
+ProcessingServer::ProcessingServer(const ConfiguracionServidor& config) : config(config) {
+    int n = config.hilos > 0 ? config.hilos : (int)std::thread::hardware_concurrency();
+    if (n < 1) n = 1;
+    this->config.tamLoteDNN = std::max(1, config.tamLoteDNN);
+    this->config.maxCortesEnCola = std::max<size_t>(this->config.tamLoteDNN, config.maxCortesEnCola);
+
+    // El modelo se carga una sola vez para toda la vida del proceso; cada hilo de
+    // proceso toma prestada su propia instancia de la red
+    redes = InferencePool::cargar(config.rutaModelo, n);
+    std::cout << "[SERVIDOR] " << (redes ? "Modelo de IA cargado." : "Sin modelo: se usara el filtro de respaldo.")
+              << " " << n << " hilos de proceso, lotes de " << this->config.tamLoteDNN << " cortes." << std::endl;
+
+    for (int h = 0; h < n; h++) {
+        procesadores.emplace_back(new ImageProcessor());
+        procesadores.back()->compartirRed(redes);
+        procesadores.back()->configurarInferencia(this->config.tamLoteDNN);
+    }
+    for (int h = 0; h < n; h++) hilos.emplace_back(&ProcessingServer::trabajador, this, std::ref(*procesadores[h]));
+}
+
+ProcessingServer::~ProcessingServer() {
+    {
+        std::lock_guard<std::mutex> lock(mtxCola);
+        parar = true;
+    }
+    hayTareas.notify_all();
+    hayHueco.notify_all();
+    for (auto& h : hilos) h.join();
+}
+
+// --- BUCLE DE CONEXIONES ---
+
+int ProcessingServer::ejecutar() {
+    // 1. Socket Unix (el de una ejecución anterior se sustituye)
+    sockaddr_un dir;
+    if (!abrirSocket(config.socket, dir)) {
+        std::cerr << "[AVISO] Ruta de socket demasiado larga: " << config.socket << std::endl;
+        return -1;
+    }
+    fdEscucha = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(config.socket.c_str());
+    if (fdEscucha < 0 || bind(fdEscucha, (sockaddr*)&dir, sizeof(dir)) != 0 || listen(fdEscucha, 64) != 0) {
+        std::cerr << "[AVISO] No se pudo escuchar en " << config.socket << ": " << std::strerror(errno) << std::endl;
+        if (fdEscucha >= 0) close(fdEscucha);
+        return -1;
+    }
+
+    // Sin SA_RESTART: accept() vuelve en cuanto llega la señal
+    fdEscuchaSenal = fdEscucha;
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = manejarSenal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::cout << "[SERVIDOR] Escuchando en " << config.socket << std::endl;
+
+    // 2. Un hilo por conexión, hasta 'maxConexiones'; las demás se rechazan al momento
+    while (!apagar && !senalRecibida) {
+        int fd = accept(fdEscucha, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;   // Socket cerrado por APAGAR o por la señal
+        }
+        if (conexiones >= config.maxConexiones) {
+            enviarTodo(fd, "ERROR OCUPADO\n");
+            close(fd);
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtxConexiones);
+            conexiones++;
+            descriptores.insert(fd);
+        }
+        std::thread(&ProcessingServer::atenderConexion, this, fd).detach();
+    }
+
+    // 3. Cierre ordenado: no se aceptan peticiones nuevas y se terminan las que están en curso
+    apagar = true;
+    fdEscuchaSenal = -1;
+    close(fdEscucha);
+    unlink(config.socket.c_str());
+    // Las conexiones inactivas se cierran para leer: un cliente sin peticiones no retiene el
+    // servidor, y las que están procesando terminan y envían su respuesta
+    {
+        std::unique_lock<std::mutex> lock(mtxConexiones);
+        for (int fd : descriptores) shutdown(fd, SHUT_RD);
+        sinConexiones.wait(lock, [this] { return conexiones == 0; });
+    }
+    std::cout << "[SERVIDOR] Apagado. " << cortesProcesados.load() << " cortes en " << lotesProcesados.load()
+              << " lotes (" << (lotesProcesados > 0 ? (double)cortesProcesados / lotesProcesados : 0.0)
+              << " cortes/lote)." << std::endl;
+    return 0;
+}
+
+void ProcessingServer::atenderConexion(int fd) {
+    std::string pendiente, linea;
+    while (!apagar && leerLinea(fd, pendiente, linea)) {
+        if (linea.empty()) continue;
+        if (!enviarTodo(fd, responder(linea) + "\n")) break;
+    }
+    std::lock_guard<std::mutex> lock(mtxConexiones);
+    descriptores.erase(fd);
+    close(fd);
+    conexiones--;
+    sinConexiones.notify_all();
+}
+
+std::string ProcessingServer::responder(const std::string& linea) {
+    std::vector<std::string> args = tokenizar(linea);
+    if (args.empty()) return "ERROR Peticion vacia";
+
+    if (args[0] == "ESTADO") {
+        size_t enCola;
+        {
+            std::lock_guard<std::mutex> lock(mtxCola);
+            enCola = cola.size();
+        }
+        std::ostringstream r;
+        r << "OK cola=" << enCola << "/" << config.maxCortesEnCola << " trabajos=" << trabajosActivos.load()
+          << " procesados=" << cortesProcesados.load() << " lotes=" << lotesProcesados.load()
+          << " redes=" << (redes ? redes->instancias() : 0);
+        {
+            std::lock_guard<std::mutex> lock(mtxMemoria);
+            r << " memoria_mb=" << memoriaReservada / MB << "/" << config.memoriaMaxMB;
+        }
+        return r.str();
+    }
+    if (args[0] == "APAGAR") {
+        if (!apagar.exchange(true)) shutdown(fdEscucha, SHUT_RDWR);   // Despierta a accept()
+        return "OK";
+    }
+    if (args[0] == "PROCESAR") {
+        if (args.size() < 2) return "ERROR Falta la carpeta de la serie";
+        ConfiguracionPipeline pipeline;
+        for (size_t i = 2; i < args.size(); i++) {
+            std::string error;
+            if (!leerOpcionPipeline(args, i, pipeline, error)) return "ERROR Argumento desconocido '" + args[i] + "'";
+            if (!error.empty()) return "ERROR " + error;
+        }
+        return procesarTrabajo(args[1], pipeline);
+    }
+    return "ERROR Peticion desconocida '" + args[0] + "'";
+}
+
+// --- TRABAJOS ---
+
+std::string ProcessingServer::procesarTrabajo(const std::string& carpeta, const ConfiguracionPipeline& pipeline) {
+    int64 t0 = cv::getTickCount();
+    std::shared_ptr<Trabajo> t = std::make_shared<Trabajo>();
+    t->id = siguienteId++;
+    t->config = pipeline;
+
+    // 1. Serie: solo encabezados (la más larga si la carpeta tiene varias). Su tamaño se
+    // reserva del techo de memoria antes de decodificar nada.
+    std::vector<SerieDicom> series = DicomHandler::descubrirSeries(carpeta, false);
+    if (series.empty()) return "ERROR No se encontraron imagenes en " + carpeta;
+    const SerieDicom& serie = *std::max_element(series.begin(), series.end(),
+        [](const SerieDicom& a, const SerieDicom& b) { return a.archivos.size() < b.archivos.size(); });
+    t->archivos = serie.archivos;
+
+    bool usar3D = pipeline.usar3D && (pipeline.modo == 1 || pipeline.modo == 2);
+    const size_t techo = config.memoriaMaxMB * MB;
+    // Si el escaneo no pudo leer Rows/Columns se asume 512x512 (como en el modo lote)
+    size_t pixeles = (serie.alto > 0 && serie.ancho > 0) ? (size_t)serie.alto * serie.ancho : 512u * 512u;
+    size_t bytesVolumen = serie.archivos.size() * pixeles * sizeof(PixelType);
+    if (usar3D) bytesVolumen += serie.archivos.size() * pixeles * BYTES_VOXEL_3D;
+    bool cabe = techo == 0 || bytesVolumen <= techo;
+    size_t reservados = cabe ? bytesVolumen : 0;
+
+    trabajosActivos++;
+    std::cout << "[SERVIDOR] Trabajo " << t->id << ": " << carpeta << " (" << t->archivos.size() << " cortes, "
+              << ImageProcessor::nombreModo(pipeline.modo) << ")" << std::endl;
+    if (!cabe) {
+        std::cout << "[SERVIDOR] Trabajo " << t->id << ": la serie (" << bytesVolumen / MB << " MB) supera el techo de "
+                  << config.memoriaMaxMB << " MB: se procesa corte a corte" << (usar3D ? " y sin segmentacion 3D." : ".")
+                  << std::endl;
+    }
+    reservarMemoria(reservados);
+
+    // La caché mapeada evita decodificar otra vez si la misma serie se pide de nuevo
+    DicomHandler dicom;
+    VolumenCT volumen;
+    std::unique_ptr<VolumeCache> cache;
+    if (!config.carpetaCacheVolumen.empty()) cache = VolumeCache::paraSerie(config.carpetaCacheVolumen, serie, carpeta);
+    if (cabe && dicom.cargarSerieDicom(serie, volumen, cache.get())) t->archivos = volumen.archivos;
+
+    // 2. Segmentación volumétrica (Hueso/Pulmón): una vez por trabajo, antes de encolar
+    cv::Mat mascaraVolumen;
+    if (usar3D && !volumen.vacio()) {
+        Segmenter3D seg3D;
+        mascaraVolumen = pipeline.modo == 1 ? seg3D.segmentarHueso3D(volumen, pipeline.usarMorf)
+                                            : seg3D.segmentarPulmon3D(volumen, pipeline.usarMorf);
+    }
+
+    // 3. Salida propia del trabajo (la respuesta espera a que sus archivos estén en disco)
+    ConfiguracionExportacion confExport = config.exportacion;
+    confExport.carpeta = config.carpetaSalida + "/" + std::to_string(t->id);
+    t->exportador.reset(new ResultExporter(confExport));
+    t->estadisticas.reiniciar((int)t->archivos.size(), volumen.vacio() ? serie.espaciado : volumen.espaciado,
+                              ImageProcessor::nombreModo(pipeline.modo));
+    t->pendientes = (int)t->archivos.size();
+
+    // 4. Cortes a la cola común: con la cola llena, esta conexión espera
+    DicomHandler dicomIO;
+    for (size_t z = 0; z < t->archivos.size(); z++) {
+        TareaCorte tarea;
+        tarea.trabajo = t;
+        tarea.indice = (int)z;
+        tarea.hu = volumen.vacio() ? dicomIO.cargarImagenDicom(t->archivos[z]) : volumen.corte((int)z);
+        if (tarea.hu.empty()) {
+            terminarCorte(*t, false);
+            continue;
+        }
+        if (!mascaraVolumen.empty()) {
+            tarea.mascaraPrevia = mascaraVolumen.rowRange((int)z * volumen.alto, ((int)z + 1) * volumen.alto);
+        }
+        encolarCorte(std::move(tarea));
+    }
+
+    // 5. Esperar al último corte y a su escritura
+    {
+        std::unique_lock<std::mutex> lock(t->mtx);
+        t->terminado.wait(lock, [&] { return t->pendientes == 0; });
+    }
+    t->exportador->esperar();
+    t->estadisticas.exportarCSV(confExport.carpeta + "/estadisticas.csv", t->archivos);
+    t->estadisticas.exportarJSON(confExport.carpeta + "/estadisticas.json", t->archivos);
+    // Los cortes encolados eran vistas del volumen: ya se puede soltar
+    volumen = VolumenCT();
+    mascaraVolumen.release();
+    liberarMemoria(reservados);
+    trabajosActivos--;
+
+    double ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+    std::ostringstream r;
+    r << "OK id=" << t->id << " cortes=" << t->procesados.load() << " fallidos=" << t->fallidos.load()
+      << " ms=" << ms << " volumen_ml=" << t->estadisticas.volumenMl(t->estadisticas.total())
+      << " salida=" << confExport.carpeta;
+    std::cout << "[SERVIDOR] Trabajo " << t->id << " terminado en " << ms << " ms." << std::endl;
+    return r.str();
+}
+
+void ProcessingServer::encolarCorte(TareaCorte tarea) {
+    {
+        std::unique_lock<std::mutex> lock(mtxCola);
+        hayHueco.wait(lock, [this] { return cola.size() < config.maxCortesEnCola || parar; });
+        cola.push_back(std::move(tarea));
+    }
+    hayTareas.notify_one();
+}
+
+void ProcessingServer::reservarMemoria(size_t bytes) {
+    if (bytes == 0 || config.memoriaMaxMB == 0) return;
+    std::unique_lock<std::mutex> lock(mtxMemoria);
+    // Un volumen siempre cabe solo: se espera a que los demás trabajos suelten los suyos
+    hayMemoria.wait(lock, [&] { return memoriaReservada + bytes <= config.memoriaMaxMB * MB; });
+    memoriaReservada += bytes;
+}
+
+void ProcessingServer::liberarMemoria(size_t bytes) {
+    if (bytes == 0 || config.memoriaMaxMB == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(mtxMemoria);
+        memoriaReservada -= bytes;
+    }
+    hayMemoria.notify_all();
+}
+
+void ProcessingServer::terminarCorte(Trabajo& t, bool ok) {
+    if (ok) t.procesados++;
+    else t.fallidos++;
+    if (--t.pendientes == 0) {
+        // Con el candado: la conexión no puede perder el aviso entre comprobar y dormir
+        std::lock_guard<std::mutex> lock(t.mtx);
+        t.terminado.notify_all();
+    }
+}
+
+// --- HILOS DE PROCESO ---
+
+void ProcessingServer::trabajador(ImageProcessor& proc) {
+    const auto espera = std::chrono::duration<double, std::milli>(config.esperaLoteMs);
+    const size_t tamLote = (size_t)config.tamLoteDNN;
+
+    while (true) {
+        // 1. Lote: el primer corte de la cola y los siguientes con su misma configuración.
+        // Si hay menos de un lote, se espera un momento a que lleguen cortes de otras peticiones.
+        std::vector<TareaCorte> lote;
+        {
+            std::unique_lock<std::mutex> lock(mtxCola);
+            hayTareas.wait(lock, [this] { return !cola.empty() || parar; });
+            if (cola.empty()) return;
+            if (cola.size() < tamLote && config.esperaLoteMs > 0) {
+                hayTareas.wait_for(lock, espera, [&] { return cola.size() >= tamLote || parar; });
+            }
+            if (cola.empty()) continue;   // Otro hilo se llevó los cortes mientras se esperaba
+            ConfiguracionPipeline referencia = cola.front().trabajo->config;
+            for (auto it = cola.begin(); it != cola.end() && lote.size() < tamLote;) {
+                if (mismaConfiguracion(it->trabajo->config, referencia)) {
+                    lote.push_back(std::move(*it));
+                    it = cola.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        hayHueco.notify_all();
+
+        // 2. Una sola inferencia para todo el lote
+        std::vector<cv::Mat> hu, mascaras;
+        for (const TareaCorte& tc : lote) {
+            hu.push_back(tc.hu);
+            mascaras.push_back(tc.mascaraPrevia);
+        }
+        const ConfiguracionPipeline& c = lote[0].trabajo->config;
+        std::vector<ResultadoPipeline> res = proc.procesarLote(hu, c, mascaras);
+        lotesProcesados++;
+
+        // 3. Estadísticas y escritura de cada corte en la salida de su trabajo
+        for (size_t k = 0; k < lote.size(); k++) {
+            Trabajo& t = *lote[k].trabajo;
+            EstadisticasRegion e;
+            RegionStats::medir(res[k].hu, res[k].mascara, e);
+            t.estadisticas.actualizarCorte(lote[k].indice, e);
+
+            const std::string& ruta = t.archivos[lote[k].indice];
+            t.exportador->encolar(ruta.substr(ruta.find_last_of("/\\") + 1), res[k].original, res[k].procesada,
+                                  res[k].mascara, res[k].final, false, true);
+            cortesProcesados++;
+            terminarCorte(t, true);
+        }
+    }
+}
+
+// --- CLIENTE ---
+
+bool ProcessingServer::enviarPeticion(const std::string& rutaSocket, const std::string& peticion,
+                                      std::string& respuesta) {
+    sockaddr_un dir;
+    if (!abrirSocket(rutaSocket, dir)) return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    bool ok = connect(fd, (sockaddr*)&dir, sizeof(dir)) == 0;
+    std::string pendiente;
+    ok = ok && enviarTodo(fd, peticion + "\n") && leerLinea(fd, pendiente, respuesta);
+    close(fd);
+    return ok;
+}
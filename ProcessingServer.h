@@ -0,0 +1,120 @@
+#ifndef PROCESSINGSERVER_H
+#define PROCESSINGSERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ImageProcessor.h"
+#include "RegionStats.h"
+#include "ResultExporter.h"
+
+// Configuración del modo servidor (proceso residente)
+struct ConfiguracionServidor {
+    std::string socket = "/tmp/integrador.sock";   // Socket Unix donde se escuchan las peticiones
+    int hilos = 0;                                  // 0 = todos los núcleos disponibles
+    int tamLoteDNN = 8;                             // Cortes por inferencia de la red
+    std::string rutaModelo = "dncnn.onnx";
+    size_t maxCortesEnCola = 256;                   // Cortes en cola antes de frenar a los clientes
+    int maxConexiones = 16;                         // Peticiones simultáneas; por encima se responde OCUPADO
+    double esperaLoteMs = 2.0;                      // Espera para juntar cortes de varias peticiones en un lote
+    std::string carpetaSalida = "Resultados_Output/servidor";   // Cada trabajo en <carpetaSalida>/<id>
+    std::string carpetaCacheVolumen;                // Cachés mapeadas de las series pedidas; vacío = sin caché
+    size_t memoriaMaxMB = 4096;                     // Techo de los volúmenes residentes de todos los trabajos (0 = sin límite)
+    ConfiguracionExportacion exportacion;           // Formato y compresión de los resultados
+};
+
+// Servidor local de procesamiento: carga el modelo una vez y atiende trabajos por un
+// socket Unix con un protocolo de texto (una petición por línea, una respuesta por línea):
+//
+//   PROCESAR <carpeta> [--mode ..] [--clahe] [--dnn] [--filtro ..] [--sin-morf] [--bordes] [--3d]
+//       -> OK id=<n> cortes=<n> fallidos=<n> ms=<t> volumen_ml=<v> salida=<carpeta>
+//   ESTADO   -> OK cola=<n>/<max> trabajos=<n> procesados=<n> lotes=<n> redes=<n> memoria_mb=<n>/<max>
+//   APAGAR   -> OK (termina los trabajos en curso y sale)
+//   Errores  -> ERROR <motivo>  (OCUPADO si se superan las conexiones simultáneas)
+//
+// Cada conexión decodifica su serie y mete los cortes en una cola común acotada: si está
+// llena, la conexión espera (contrapresión hasta el cliente). Antes de decodificar, el
+// volumen reserva su tamaño (estimado con los encabezados) del techo de memoria: si no
+// hay sitio, la conexión espera a que otros trabajos terminen, y una serie mayor que todo
+// el techo se decodifica corte a corte (sin segmentación 3D). Los hilos de proceso sacan
+// hasta 'tamLoteDNN' cortes con la misma configuración, aunque vengan de peticiones
+// distintas, y los filtran en una sola inferencia. La respuesta llega cuando todos los
+// cortes del trabajo están procesados y escritos en disco.
+class ProcessingServer {
+public:
+    explicit ProcessingServer(const ConfiguracionServidor& config);
+    ~ProcessingServer();
+
+    // Escucha hasta recibir APAGAR (o SIGINT/SIGTERM). Devuelve el código de salida.
+    int ejecutar();
+
+    // Cliente: envía una línea al servidor y deja su respuesta en 'respuesta'
+    static bool enviarPeticion(const std::string& socket, const std::string& peticion, std::string& respuesta);
+
+private:
+    struct Trabajo {
+        int id = 0;
+        ConfiguracionPipeline config;
+        std::vector<std::string> archivos;
+        std::unique_ptr<ResultExporter> exportador;
+        RegionStats estadisticas;
+        std::atomic<int> pendientes{0};
+        std::atomic<int> procesados{0};
+        std::atomic<int> fallidos{0};
+        std::mutex mtx;
+        std::condition_variable terminado;
+    };
+
+    // Un corte en la cola común
+    struct TareaCorte {
+        std::shared_ptr<Trabajo> trabajo;
+        int indice = 0;
+        cv::Mat hu;
+        cv::Mat mascaraPrevia;   // Corte de la máscara 3D (opcional)
+    };
+
+    void atenderConexion(int fd);
+    std::string responder(const std::string& linea);
+    std::string procesarTrabajo(const std::string& carpeta, const ConfiguracionPipeline& pipeline);
+
+    void encolarCorte(TareaCorte tarea);   // Espera si la cola está llena
+    void reservarMemoria(size_t bytes);    // Espera hasta que quepa en el techo
+    void liberarMemoria(size_t bytes);
+    void trabajador(ImageProcessor& proc);
+    void terminarCorte(Trabajo& t, bool ok);
+
+    ConfiguracionServidor config;
+    std::shared_ptr<InferencePool> redes;   // Un modelo para todos los hilos de proceso
+    std::vector<std::unique_ptr<ImageProcessor>> procesadores;
+    std::vector<std::thread> hilos;
+
+    std::deque<TareaCorte> cola;
+    std::mutex mtxCola;
+    std::condition_variable hayTareas, hayHueco;
+    bool parar = false;
+
+    size_t memoriaReservada = 0;   // Volúmenes de los trabajos en curso (protegido por mtxMemoria)
+    std::mutex mtxMemoria;
+    std::condition_variable hayMemoria;
+
+    std::atomic<bool> apagar{false};
+    std::atomic<int> conexiones{0};
+    std::mutex mtxConexiones;
+    std::condition_variable sinConexiones;
+    std::set<int> descriptores;   // Conexiones abiertas (protegido por mtxConexiones)
+    int fdEscucha = -1;
+    std::atomic<int> trabajosActivos{0};
+
+    std::atomic<int> siguienteId{1};
+    std::atomic<long long> cortesProcesados{0};
+    std::atomic<long long> lotesProcesados{0};
+};
+
+#endif
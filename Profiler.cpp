@@ -0,0 +1,146 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+Profiler& Profiler::global() {
+    static Profiler instancia;
+    return instancia;
+}
+
+Profiler::Profiler() {
+    reiniciar();
+}
+
+void Profiler::reiniciar() {
+    for (auto& h : etapas) {
+        for (auto& c : h.cubetas) c = 0;
+        h.muestras = 0;
+        h.sumaUs = 0;
+        h.maxUs = 0;
+        h.ultimaUs = 0;
+    }
+}
+
+// Cubeta i cubre [2^(i/4), 2^((i+1)/4)) microsegundos (desplazado en 1 para incluir el 0)
+static inline int cubetaDe(long long us) {
+    return (int)(4.0 * std::log2((double)us + 1.0));
+}
+
+void Profiler::registrar(int etapa, int64 ticks) {
+    if (etapa < 0 || etapa >= NUM_ETAPAS_PERF) return;
+    static const double usPorTick = 1e6 / cv::getTickFrequency();
+    long long us = (long long)(ticks * usPorTick);
+    Histograma& h = etapas[etapa];
+
+    h.cubetas[std::min(cubetaDe(us), NUM_CUBETAS - 1)].fetch_add(1, std::memory_order_relaxed);
+    h.muestras.fetch_add(1, std::memory_order_relaxed);
+    h.sumaUs.fetch_add(us, std::memory_order_relaxed);
+    h.ultimaUs.store(us, std::memory_order_relaxed);
+    long long maximo = h.maxUs.load(std::memory_order_relaxed);
+    while (us > maximo && !h.maxUs.compare_exchange_weak(maximo, us, std::memory_order_relaxed)) {}
+}
+
+double Profiler::percentilMs(const Histograma& h, long long total, double p) const {
+    long long objetivo = (long long)std::ceil(p * total), acumulado = 0;
+    for (int i = 0; i < NUM_CUBETAS; i++) {
+        acumulado += h.cubetas[i].load(std::memory_order_relaxed);
+        if (acumulado >= std::max(1LL, objetivo)) {
+            // Centro geométrico de la cubeta
+            return (std::pow(2.0, (i + 0.5) / 4.0) - 1.0) / 1000.0;
+        }
+    }
+    return 0.0;
+}
+
+Profiler::Resumen Profiler::resumen(int etapa) const {
+    Resumen r;
+    if (etapa < 0 || etapa >= NUM_ETAPAS_PERF) return r;
+    const Histograma& h = etapas[etapa];
+    r.muestras = h.muestras.load(std::memory_order_relaxed);
+    if (r.muestras == 0) return r;
+    r.mediaMs = h.sumaUs.load(std::memory_order_relaxed) / 1000.0 / r.muestras;
+    r.p50Ms = percentilMs(h, r.muestras, 0.50);
+    r.p95Ms = percentilMs(h, r.muestras, 0.95);
+    r.p99Ms = percentilMs(h, r.muestras, 0.99);
+    // El máximo es exacto: el percentil nunca lo supera
+    r.maxMs = h.maxUs.load(std::memory_order_relaxed) / 1000.0;
+    r.p50Ms = std::min(r.p50Ms, r.maxMs);
+    r.p95Ms = std::min(r.p95Ms, r.maxMs);
+    r.p99Ms = std::min(r.p99Ms, r.maxMs);
+    r.ultimaMs = h.ultimaUs.load(std::memory_order_relaxed) / 1000.0;
+    return r;
+}
+
+const char* Profiler::nombreEtapa(int etapa) {
+    switch (etapa) {
+        case PERF_DECODIFICAR:     return "decodificar_dicom";
+        case PERF_VOLUMEN:         return "cargar_volumen";
+        case PERF_VENTANA:         return "ventana_hu";
+        case PERF_CLAHE:           return "clahe";
+        case PERF_DNN:             return "dnn";
+        case PERF_FILTRO_RUIDO:    return "filtro_ruido";
+        case PERF_SEGMENTACION:    return "segmentacion";
+        case PERF_OVERLAY:         return "overlay";
+        case PERF_SEGMENTACION_3D: return "segmentacion_3d";
+        case PERF_MPR:             return "mpr";
+        case PERF_ESTADISTICAS:    return "estadisticas";
+        case PERF_DESCOMPRIMIR:    return "descomprimir_corte";
+        case PERF_CONTORNOS:       return "contornos";
+        case PERF_GUARDADO:        return "guardado";
+        case PERF_DIBUJO:          return "dibujo_gui";
+        case PERF_FOTOGRAMA:       return "fotograma";
+        default:                   return "?";
+    }
+}
+
+void Profiler::imprimirResumen() const {
+    // La tabla se formatea aparte: std::cout conserva su precisión y formato
+    std::ostringstream tabla;
+    tabla << "[PERF] Etapa                 Muestras    p50 ms    p95 ms    p99 ms    max ms\n";
+    tabla << std::fixed << std::setprecision(2);
+    for (int e = 0; e < NUM_ETAPAS_PERF; e++) {
+        Resumen r = resumen(e);
+        if (r.muestras == 0) continue;
+        tabla << "[PERF] " << std::left << std::setw(20) << nombreEtapa(e) << std::right
+              << std::setw(10) << r.muestras
+              << std::setw(10) << r.p50Ms << std::setw(10) << r.p95Ms
+              << std::setw(10) << r.p99Ms << std::setw(10) << r.maxMs << "\n";
+    }
+    std::cout << tabla.str() << std::flush;
+}
+
+bool Profiler::exportarJSON(const std::string& ruta) const {
+    std::ofstream f(ruta);
+    if (!f) return false;
+    f << "{\n  \"etapas\": [";
+    bool primero = true;
+    for (int e = 0; e < NUM_ETAPAS_PERF; e++) {
+        Resumen r = resumen(e);
+        if (r.muestras == 0) continue;
+        f << (primero ? "\n" : ",\n");
+        f << "    {\"nombre\": \"" << nombreEtapa(e) << "\", \"muestras\": " << r.muestras
+          << ", \"media_ms\": " << r.mediaMs << ", \"p50_ms\": " << r.p50Ms
+          << ", \"p95_ms\": " << r.p95Ms << ", \"p99_ms\": " << r.p99Ms
+          << ", \"max_ms\": " << r.maxMs << "}";
+        primero = false;
+    }
+    f << "\n  ]\n}\n";
+    return (bool)f;
+}
+
+bool Profiler::exportarCSV(const std::string& ruta) const {
+    std::ofstream f(ruta);
+    if (!f) return false;
+    f << "etapa,muestras,media_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+    for (int e = 0; e < NUM_ETAPAS_PERF; e++) {
+        Resumen r = resumen(e);
+        if (r.muestras == 0) continue;
+        f << nombreEtapa(e) << "," << r.muestras << "," << r.mediaMs << "," << r.p50Ms << ","
+          << r.p95Ms << "," << r.p99Ms << "," << r.maxMs << "\n";
+    }
+    return (bool)f;
+}
@@ -0,0 +1,77 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <string>
+#include <opencv2/core.hpp>
+
+// Etapas instrumentadas del pipeline
+enum EtapaPerf {
+    PERF_DECODIFICAR = 0,   // DicomHandler::cargarImagenDicom
+    PERF_VOLUMEN,           // DicomHandler::cargarVolumenDicom (serie completa)
+    PERF_VENTANA,           // Ventana HU -> 8 bits
+    PERF_CLAHE,
+    PERF_DNN,               // Inferencia DnCNN por teselas
+    PERF_FILTRO_RUIDO,      // Filtros clásicos (NL-Means, bilateral, guiado)
+    PERF_SEGMENTACION,      // Umbral + morfología (+ overlay en el kernel fusionado)
+    PERF_OVERLAY,           // crearOverlay por separado
+    PERF_SEGMENTACION_3D,
+    PERF_MPR,               // Reformateo coronal/sagital desde el volumen
+    PERF_ESTADISTICAS,      // Estadísticas de la ROI (RegionStats::medir)
+    PERF_DESCOMPRIMIR,      // Corte en HU desde el almacén comprimido (SliceStore)
+    PERF_CONTORNOS,         // Contornos vectoriales de la máscara (ContourExtractor)
+    PERF_GUARDADO,
+    PERF_DIBUJO,            // Renderizado de la GUI + imshow
+    PERF_FOTOGRAMA,         // Fotograma completo del visor (solo los que hicieron trabajo)
+    NUM_ETAPAS_PERF
+};
+
+// Instrumentación siempre activa con coste despreciable: cada muestra son dos lecturas
+// del reloj y unos incrementos atómicos en un histograma logarítmico (4 cubetas por
+// octava, ~9% de resolución) por etapa. Es seguro usarlo desde varios hilos.
+class Profiler {
+public:
+    static Profiler& global();
+
+    void registrar(int etapa, int64 ticks);
+
+    struct Resumen {
+        long long muestras = 0;
+        double mediaMs = 0, p50Ms = 0, p95Ms = 0, p99Ms = 0, maxMs = 0, ultimaMs = 0;
+    };
+    Resumen resumen(int etapa) const;
+    static const char* nombreEtapa(int etapa);
+
+    void reiniciar();
+    void imprimirResumen() const;
+    bool exportarJSON(const std::string& ruta) const;
+    bool exportarCSV(const std::string& ruta) const;
+
+private:
+    static const int NUM_CUBETAS = 128;   // Hasta 2^32 us
+    struct Histograma {
+        std::atomic<long long> cubetas[NUM_CUBETAS];
+        std::atomic<long long> muestras;
+        std::atomic<long long> sumaUs;
+        std::atomic<long long> maxUs;
+        std::atomic<long long> ultimaUs;
+    };
+    Histograma etapas[NUM_ETAPAS_PERF];
+
+    Profiler();
+    double percentilMs(const Histograma& h, long long total, double p) const;
+};
+
+// Temporizador por ámbito: registra el tiempo de vida del objeto en la etapa dada
+class TemporizadorEtapa {
+public:
+    explicit TemporizadorEtapa(int etapa) : etapa(etapa), inicio(cv::getTickCount()) {}
+    ~TemporizadorEtapa() { if (etapa >= 0) Profiler::global().registrar(etapa, cv::getTickCount() - inicio); }
+    void cancelar() { etapa = -1; }
+
+private:
+    int etapa;
+    int64 inicio;
+};
+
+#endif
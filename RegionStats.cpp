@@ -0,0 +1,234 @@
+#include "RegionStats.h"
+#include "Profiler.h"
+#include "ResultExporter.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+// Acumulados de una fila. Sin ramas: la selección por máscara es un AND con 0 o ~0,
+// así el compilador convierte el bucle en SIMD (sumas, conteos, mínimo y máximo a la vez)
+struct AcumuladoFila {
+    int pixeles = 0, cuerpo = 0, suma = 0;
+    int64_t suma2 = 0;
+    int minHU = SHRT_MAX, maxHU = SHRT_MIN;
+};
+
+void acumularFila(const short* __restrict h, const uchar* __restrict m, int n, AcumuladoFila& a) {
+    int pixeles = 0, cuerpo = 0, suma = 0, minHU = SHRT_MAX, maxHU = SHRT_MIN;
+    int64_t suma2 = 0;
+    for (int x = 0; x < n; x++) {
+        int v = h[x];
+        int sel = -(int)(m[x] != 0);   // 0 o -1 (todos los bits a 1)
+        int vs = v & sel;
+        pixeles -= sel;
+        cuerpo += v > HU_CUERPO_MIN;
+        suma += vs;
+        suma2 += (unsigned)(vs * vs);
+        minHU = std::min(minHU, vs | (SHRT_MAX & ~sel));
+        maxHU = std::max(maxHU, vs | (SHRT_MIN & ~sel));
+    }
+    a.pixeles = pixeles; a.cuerpo = cuerpo; a.suma = suma; a.suma2 = suma2;
+    a.minHU = minHU; a.maxHU = maxHU;
+}
+
+inline int binHU(int v) {
+    return std::min(std::max((v - HIST_MIN_HU) / HIST_ANCHO_BIN, 0), HIST_BINS - 1);
+}
+
+} // namespace
+
+// --- ESTADISTICAS DE UNA REGION ---
+
+double EstadisticasRegion::mediaHU() const {
+    return pixeles > 0 ? (double)sumaHU / pixeles : 0.0;
+}
+
+double EstadisticasRegion::desviacionHU() const {
+    if (pixeles < 2) return 0.0;
+    double media = mediaHU();
+    return std::sqrt(std::max(0.0, (double)sumaHU2 / pixeles - media * media));
+}
+
+void EstadisticasRegion::sumar(const EstadisticasRegion& e) {
+    pixeles += e.pixeles;
+    pixelesCuerpo += e.pixelesCuerpo;
+    sumaHU += e.sumaHU;
+    sumaHU2 += e.sumaHU2;
+    minHU = std::min(minHU, e.minHU);
+    maxHU = std::max(maxHU, e.maxHU);
+    for (int b = 0; b < HIST_BINS; b++) histograma[b] += e.histograma[b];
+}
+
+void EstadisticasRegion::restar(const EstadisticasRegion& e) {
+    // El mínimo y el máximo no se pueden "restar": los recalcula RegionStats::total()
+    pixeles -= e.pixeles;
+    pixelesCuerpo -= e.pixelesCuerpo;
+    sumaHU -= e.sumaHU;
+    sumaHU2 -= e.sumaHU2;
+    for (int b = 0; b < HIST_BINS; b++) histograma[b] -= e.histograma[b];
+}
+
+// --- MEDIDA DE UN CORTE ---
+
+void RegionStats::medir(const cv::Mat& hu, const cv::Mat& mascara, EstadisticasRegion& salida) {
+    salida = EstadisticasRegion();
+    salida.valida = true;
+    if (hu.empty() || hu.type() != CV_16SC1 || mascara.size() != hu.size() || mascara.type() != CV_8UC1) {
+        std::cerr << "[AVISO] Estadisticas: la mascara no corresponde al corte en HU." << std::endl;
+        return;
+    }
+
+    TemporizadorEtapa tiempo(PERF_ESTADISTICAS);
+    for (int y = 0; y < hu.rows; y++) {
+        const short* h = hu.ptr<short>(y);
+        const uchar* m = mascara.ptr<uchar>(y);
+
+        // 1. Sumas, conteos y extremos (vectorizado)
+        AcumuladoFila a;
+        acumularFila(h, m, hu.cols, a);
+        salida.pixelesCuerpo += a.cuerpo;
+        if (a.pixeles == 0) continue;
+        salida.pixeles += a.pixeles;
+        salida.sumaHU += a.suma;
+        salida.sumaHU2 += a.suma2;
+        salida.minHU = std::min(salida.minHU, a.minHU);
+        salida.maxHU = std::max(salida.maxHU, a.maxHU);
+
+        // 2. Histograma de la misma fila, aún en L1
+        for (int x = 0; x < hu.cols; x++) {
+            if (m[x]) salida.histograma[binHU(h[x])]++;
+        }
+    }
+}
+
+// --- AGREGADO DE LA SERIE ---
+
+void RegionStats::reiniciar(int n, const double espaciado[3], const std::string& nombre) {
+    std::lock_guard<std::mutex> lock(mtx);
+    cortes.assign(std::max(n, 0), EstadisticasRegion());
+    agregado = EstadisticasRegion();
+    medidos = 0;
+    double ex = espaciado[0] > 0 ? espaciado[0] : 1.0;
+    double ey = espaciado[1] > 0 ? espaciado[1] : 1.0;
+    double ez = espaciado[2] > 0 ? espaciado[2] : 1.0;
+    mm2Pixel = ex * ey;
+    mm3Voxel = ex * ey * ez;
+    etiqueta = nombre;
+}
+
+void RegionStats::actualizarCorte(int z, const EstadisticasRegion& e) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (z < 0 || z >= (int)cortes.size()) return;
+    EstadisticasRegion& anterior = cortes[z];
+    if (anterior.valida) agregado.restar(anterior);
+    else medidos++;
+    anterior = e;
+    anterior.valida = true;
+    agregado.sumar(anterior);
+}
+
+EstadisticasRegion RegionStats::corte(int z) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return (z >= 0 && z < (int)cortes.size()) ? cortes[z] : EstadisticasRegion();
+}
+
+EstadisticasRegion RegionStats::total() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    EstadisticasRegion t = agregado;
+    t.valida = medidos > 0;
+    t.minHU = SHRT_MAX;
+    t.maxHU = SHRT_MIN;
+    for (const EstadisticasRegion& c : cortes) {
+        if (!c.valida || c.pixeles == 0) continue;
+        t.minHU = std::min(t.minHU, c.minHU);
+        t.maxHU = std::max(t.maxHU, c.maxHU);
+    }
+    return t;
+}
+
+int RegionStats::numCortes() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return (int)cortes.size();
+}
+
+int RegionStats::cortesMedidos() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return medidos;
+}
+
+// --- EXPORTACIÓN ---
+
+namespace {
+
+std::string nombreCorte(const std::vector<std::string>& archivos, size_t z) {
+    if (z >= archivos.size()) return std::to_string(z);
+    return archivos[z].substr(archivos[z].find_last_of("/\\") + 1);
+}
+
+// Sin la ROI en el corte, el mínimo y el máximo no tienen sentido
+int minSeguro(const EstadisticasRegion& e) { return e.pixeles > 0 ? e.minHU : 0; }
+int maxSeguro(const EstadisticasRegion& e) { return e.pixeles > 0 ? e.maxHU : 0; }
+
+} // namespace
+
+bool RegionStats::exportarCSV(const std::string& ruta, const std::vector<std::string>& archivos) const {
+    std::ofstream f(ruta);
+    if (!f) return false;
+    EstadisticasRegion t = total();
+    std::lock_guard<std::mutex> lock(mtx);
+    f << "corte,archivo,pixeles,area_mm2,volumen_ml,media_hu,desviacion_hu,min_hu,max_hu,fraccion_cuerpo\n";
+    for (size_t z = 0; z < cortes.size(); z++) {
+        const EstadisticasRegion& c = cortes[z];
+        if (!c.valida) continue;
+        f << z << "," << nombreCorte(archivos, z) << "," << c.pixeles << "," << areaMm2(c) << ","
+          << volumenMl(c) << "," << c.mediaHU() << "," << c.desviacionHU() << "," << minSeguro(c) << ","
+          << maxSeguro(c) << "," << c.fraccionCuerpo() << "\n";
+    }
+    f << "TOTAL," << etiqueta << "," << t.pixeles << "," << areaMm2(t) << "," << volumenMl(t) << ","
+      << t.mediaHU() << "," << t.desviacionHU() << "," << minSeguro(t) << "," << maxSeguro(t) << ","
+      << t.fraccionCuerpo() << "\n";
+    return (bool)f;
+}
+
+bool RegionStats::exportarJSON(const std::string& ruta, const std::vector<std::string>& archivos) const {
+    std::ofstream f(ruta);
+    if (!f) return false;
+    EstadisticasRegion t = total();
+    std::lock_guard<std::mutex> lock(mtx);
+    f << "{\n  \"mascara\": \"" << ResultExporter::escaparJSON(etiqueta) << "\", \"cortes\": " << cortes.size()
+      << ", \"cortes_medidos\": " << medidos << ",\n"
+      << "  \"mm2_por_pixel\": " << mm2Pixel << ", \"mm3_por_voxel\": " << mm3Voxel << ",\n"
+      << "  \"total\": {\"pixeles\": " << t.pixeles << ", \"volumen_ml\": " << volumenMl(t)
+      << ", \"media_hu\": " << t.mediaHU() << ", \"desviacion_hu\": " << t.desviacionHU()
+      << ", \"min_hu\": " << minSeguro(t) << ", \"max_hu\": " << maxSeguro(t)
+      << ", \"fraccion_cuerpo\": " << t.fraccionCuerpo() << ",\n"
+      << "    \"histograma\": {\"min_hu\": " << HIST_MIN_HU << ", \"ancho_bin\": " << HIST_ANCHO_BIN
+      << ", \"cuentas\": [";
+    for (int b = 0; b < HIST_BINS; b++) f << (b ? ", " : "") << t.histograma[b];
+    f << "]}},\n  \"por_corte\": [";
+    bool primero = true;
+    for (size_t z = 0; z < cortes.size(); z++) {
+        const EstadisticasRegion& c = cortes[z];
+        if (!c.valida) continue;
+        f << (primero ? "\n" : ",\n");
+        f << "    {\"corte\": " << z << ", \"archivo\": \"" << ResultExporter::escaparJSON(nombreCorte(archivos, z))
+          << "\", \"pixeles\": " << c.pixeles << ", \"area_mm2\": " << areaMm2(c) << ", \"media_hu\": " << c.mediaHU()
+          << ", \"desviacion_hu\": " << c.desviacionHU() << ", \"min_hu\": " << minSeguro(c)
+          << ", \"max_hu\": " << maxSeguro(c) << ", \"fraccion_cuerpo\": " << c.fraccionCuerpo() << "}";
+        primero = false;
+    }
+    f << "\n  ]\n}\n";
+    return (bool)f;
+}
+
+void RegionStats::imprimirResumen() const {
+    EstadisticasRegion t = total();
+    int n = numCortes(), medidosAhora = cortesMedidos();
+    std::cout << "[STATS] " << etiqueta << ": " << medidosAhora << "/" << n << " cortes, "
+              << volumenMl(t) << " ml, " << t.mediaHU() << " +/- " << t.desviacionHU() << " HU ["
+              << minSeguro(t) << ", " << maxSeguro(t) << "], " << t.fraccionCuerpo() * 100.0
+              << "% del cuerpo." << std::endl;
+}
@@ -0,0 +1,81 @@
+#ifndef REGIONSTATS_H
+#define REGIONSTATS_H
+
+#include <climits>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Histograma de HU dentro de la ROI: 256 intervalos de 16 HU desde -1024
+// (los valores fuera de [-1024, 3071] caen en el primer o el último intervalo)
+const int HIST_MIN_HU = -1024;
+const int HIST_ANCHO_BIN = 16;
+const int HIST_BINS = 256;
+// Umbral de "cuerpo" para las fracciones (hueso / cuerpo): todo lo que no es aire
+const int HU_CUERPO_MIN = -500;
+
+// Medidas de la ROI de un corte (o de la serie, sumando cortes).
+// Las sumas son enteras: restar un corte del total es exacto, sin deriva de redondeo.
+struct EstadisticasRegion {
+    bool valida = false;          // El corte ya se midió
+    int64_t pixeles = 0;          // Área de la ROI (píxeles)
+    int64_t pixelesCuerpo = 0;    // Píxeles del corte con HU > HU_CUERPO_MIN
+    int64_t sumaHU = 0;
+    int64_t sumaHU2 = 0;
+    int minHU = SHRT_MAX;
+    int maxHU = SHRT_MIN;
+    uint32_t histograma[HIST_BINS] = {};
+
+    double mediaHU() const;
+    double desviacionHU() const;
+    double fraccionCuerpo() const { return pixelesCuerpo > 0 ? (double)pixeles / pixelesCuerpo : 0.0; }
+
+    void sumar(const EstadisticasRegion& e);
+    void restar(const EstadisticasRegion& e);
+};
+
+// Estadísticas por corte y agregadas de la serie para la máscara del modo actual.
+// Al cambiar la máscara de un corte solo se resta su entrada anterior y se suma la nueva:
+// el total no vuelve a recorrer la serie. Se puede alimentar desde varios hilos (modo lote).
+class RegionStats {
+public:
+    // Mide la ROI (mascara != 0, CV_8U) sobre el corte en HU (CV_16S) en una sola pasada:
+    // por fila, las sumas, el mínimo y el máximo en un bucle vectorizable y el histograma
+    // mientras la fila sigue en L1
+    static void medir(const cv::Mat& hu, const cv::Mat& mascara, EstadisticasRegion& salida);
+
+    // Vacía el agregado para una serie de 'numCortes'. 'espaciado' en mm (x, y, z);
+    // 'etiqueta' identifica la máscara en la exportación (Hueso, Pulmon, ...)
+    void reiniciar(int numCortes, const double espaciado[3], const std::string& etiqueta);
+    // Sustituye la medida del corte z en el agregado
+    void actualizarCorte(int z, const EstadisticasRegion& e);
+
+    EstadisticasRegion corte(int z) const;
+    EstadisticasRegion total() const;
+    int numCortes() const;
+    int cortesMedidos() const;
+    bool completa() const { return cortesMedidos() == numCortes(); }
+
+    // Conversión de píxeles a unidades físicas con el espaciado de la serie
+    double areaMm2(const EstadisticasRegion& e) const { return e.pixeles * mm2Pixel; }
+    double volumenMl(const EstadisticasRegion& e) const { return e.pixeles * mm3Voxel / 1000.0; }
+
+    // Exportación del estudio: una fila por corte medido más la fila TOTAL (CSV),
+    // o el total con su histograma y el detalle por corte (JSON).
+    // 'archivos' (opcional) da nombre a cada corte.
+    bool exportarCSV(const std::string& ruta, const std::vector<std::string>& archivos = {}) const;
+    bool exportarJSON(const std::string& ruta, const std::vector<std::string>& archivos = {}) const;
+    void imprimirResumen() const;
+
+private:
+    mutable std::mutex mtx;
+    std::vector<EstadisticasRegion> cortes;
+    EstadisticasRegion agregado;   // Suma de los cortes válidos (min/max se recalculan en total())
+    int medidos = 0;
+    double mm2Pixel = 1.0, mm3Voxel = 1.0;
+    std::string etiqueta;
+};
+
+#endif
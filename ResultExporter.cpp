@@ -0,0 +1,221 @@
+#include "ResultExporter.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <sys/stat.h>
+
+ResultExporter::ResultExporter(const ConfiguracionExportacion& config) : config(config) {
+    this->config.hilos = std::max(1, config.hilos);
+    this->config.maxPendientes = std::max<size_t>(4, config.maxPendientes);
+    if (!crearDirectorios(this->config.carpeta)) {
+        std::cerr << "[AVISO] No se pudo crear la carpeta " << this->config.carpeta << std::endl;
+    }
+    for (int i = 0; i < this->config.hilos; i++) hilos.emplace_back(&ResultExporter::escritor, this);
+}
+
+ResultExporter::~ResultExporter() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        terminar = true;
+    }
+    hayTrabajo.notify_all();
+    for (auto& h : hilos) h.join();
+}
+
+bool ResultExporter::crearDirectorios(const std::string& ruta) {
+    // Crear cada nivel de la ruta (equivalente a mkdir -p)
+    for (size_t pos = 1; pos <= ruta.size(); pos++) {
+        if (pos == ruta.size() || ruta[pos] == '/') {
+            std::string parcial = ruta.substr(0, pos);
+            if (mkdir(parcial.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        }
+    }
+    return true;
+}
+
+int ResultExporter::formatoDesdeTexto(const std::string& texto) {
+    if (texto == "png") return EXPORT_PNG;
+    if (texto == "bmp") return EXPORT_BMP;
+    if (texto == "raw") return EXPORT_RAW;
+    return -1;
+}
+
+std::string ResultExporter::escaparJSON(const std::string& texto) {
+    std::string salida;
+    salida.reserve(texto.size());
+    for (char c : texto) {
+        switch (c) {
+            case '"': salida += "\\\""; break;
+            case '\\': salida += "\\\\"; break;
+            case '\n': salida += "\\n"; break;
+            case '\r': salida += "\\r"; break;
+            case '\t': salida += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char u[7];
+                    std::snprintf(u, sizeof(u), "\\u%04x", (unsigned char)c);
+                    salida += u;
+                } else {
+                    salida += c;
+                }
+        }
+    }
+    return salida;
+}
+
+bool ResultExporter::encolar(const std::string& nombreBase, const cv::Mat& orig, const cv::Mat& proc,
+                             const cv::Mat& mask, const cv::Mat& final, bool copiar, bool esperarSiLleno) {
+    std::string ruta = config.carpeta + "/" + nombreBase;
+    size_t lastindex = ruta.find_last_of(".");
+    std::string rawName = ruta.substr(0, lastindex);
+
+    const cv::Mat* vistas[4] = {&orig, &proc, &mask, &final};
+    const char* sufijos[4] = {"_1_Original", "_2_Procesada", "_3_Mascara", "_4_Final"};
+
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!esperarHueco(lock, 4, esperarSiLleno)) return false;
+    for (int i = 0; i < 4; i++) {
+        if (vistas[i]->empty()) continue;
+        cola.push_back({rawName + sufijos[i], copiar ? vistas[i]->clone() : *vistas[i]});
+    }
+    lock.unlock();
+    hayTrabajo.notify_all();
+    return true;
+}
+
+bool ResultExporter::encolarContornos(const std::string& nombreBase, const ContornosCorte& contornos, int indice,
+                                      const std::string& archivo, const double espaciado[3],
+                                      const std::string& etiqueta, bool esperarSiLleno) {
+    std::string ruta = config.carpeta + "/" + nombreBase;
+    Trabajo t;
+    t.rutaBase = ruta.substr(0, ruta.find_last_of(".")) + "_5_Contornos";
+    t.esContornos = true;
+    t.contornos = contornos;
+    t.indice = indice;
+    t.archivo = archivo;
+    t.etiqueta = etiqueta;
+    for (int k = 0; k < 3; k++) t.espaciado[k] = espaciado[k];
+
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!esperarHueco(lock, 1, esperarSiLleno)) return false;
+    cola.push_back(std::move(t));
+    lock.unlock();
+    hayTrabajo.notify_one();
+    return true;
+}
+
+bool ResultExporter::esperarHueco(std::unique_lock<std::mutex>& lock, size_t n, bool esperarSiLleno) {
+    if (cola.size() + n > config.maxPendientes) {
+        if (!esperarSiLleno) return false;
+        hayEspacio.wait(lock, [&] { return cola.size() + n <= config.maxPendientes; });
+    }
+    if (cola.empty() && enCurso == 0) inicioRafaga = cv::getTickCount();
+    return true;
+}
+
+void ResultExporter::esperar() {
+    std::unique_lock<std::mutex> lock(mtx);
+    sinPendientes.wait(lock, [&] { return cola.empty() && enCurso == 0; });
+}
+
+size_t ResultExporter::pendientes() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return cola.size() + enCurso;
+}
+
+void ResultExporter::escritor() {
+    while (true) {
+        Trabajo t;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            hayTrabajo.wait(lock, [&] { return terminar || !cola.empty(); });
+            if (cola.empty()) return;   // terminar y nada pendiente
+            t = std::move(cola.front());
+            cola.pop_front();
+            enCurso++;
+        }
+        hayEspacio.notify_one();
+
+        // Codificar y escribir fuera del cerrojo
+        int64 t0 = cv::getTickCount();
+        size_t bytes = 0;
+        bool ok = escribir(t, bytes);
+        double segundos = (cv::getTickCount() - t0) / cv::getTickFrequency();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        enCurso--;
+        segundosEscritores += segundos;
+        if (ok) {
+            (t.esContornos ? contornosEscritos : imagenesEscritas)++;
+            bytesEscritos += bytes;
+        } else {
+            fallos++;
+            std::cerr << "[AVISO] No se pudo escribir " << t.rutaBase << std::endl;
+        }
+        if (cola.empty() && enCurso == 0) {
+            segundosActivo += (cv::getTickCount() - inicioRafaga) / cv::getTickFrequency();
+            sinPendientes.notify_all();
+        }
+    }
+}
+
+bool ResultExporter::escribir(const Trabajo& t, size_t& bytes) {
+    TemporizadorEtapa tiempo(PERF_GUARDADO);
+    const cv::Mat& img = t.imagen;
+
+    // 0. Contornos vectoriales: JSON de un corte
+    if (t.esContornos) {
+        std::string ruta = t.rutaBase + ".json";
+        if (!ContourExtractor::exportarJSON(ruta, t.contornos, t.indice, t.archivo, t.espaciado, t.etiqueta)) return false;
+        struct stat info;
+        bytes = stat(ruta.c_str(), &info) == 0 ? (size_t)info.st_size : 0;
+        return true;
+    }
+
+    // 1. Volcado binario: sin codificar, fila a fila
+    if (config.formato == EXPORT_RAW) {
+        std::string ruta = t.rutaBase + "_" + std::to_string(img.cols) + "x" + std::to_string(img.rows)
+                         + "x" + std::to_string(img.channels()) + ".raw";
+        FILE* f = fopen(ruta.c_str(), "wb");
+        if (!f) return false;
+        size_t bytesFila = img.cols * img.elemSize();
+        bool ok = true;
+        for (int y = 0; y < img.rows && ok; y++) ok = fwrite(img.ptr(y), 1, bytesFila, f) == bytesFila;
+        ok = (fclose(f) == 0) && ok;
+        bytes = bytesFila * img.rows;
+        return ok;
+    }
+
+    // 2. PNG / BMP: se codifica en memoria y se escribe de una vez
+    std::vector<uchar> buffer;
+    std::vector<int> parametros;
+    std::string extension = ".bmp";
+    if (config.formato == EXPORT_PNG) {
+        extension = ".png";
+        parametros = {cv::IMWRITE_PNG_COMPRESSION, std::min(9, std::max(0, config.nivelPNG))};
+    }
+    if (!cv::imencode(extension, img, buffer, parametros)) return false;
+
+    FILE* f = fopen((t.rutaBase + extension).c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(buffer.data(), 1, buffer.size(), f) == buffer.size();
+    ok = (fclose(f) == 0) && ok;
+    bytes = buffer.size();
+    return ok;
+}
+
+void ResultExporter::imprimirResumen() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    double mb = bytesEscritos / (1024.0 * 1024.0);
+    std::cout << "[EXPORTAR] " << imagenesEscritas << " imagenes";
+    if (contornosEscritos > 0) std::cout << " + " << contornosEscritos << " contornos";
+    std::cout << " (" << mb << " MB) en "
+              << segundosActivo << " s: "
+              << (segundosActivo > 0 ? mb / segundosActivo : 0.0) << " MB/s con " << config.hilos
+              << " escritores (" << (segundosEscritores > 0 ? mb / segundosEscritores : 0.0)
+              << " MB/s por escritor)";
+    if (fallos > 0) std::cout << ", " << fallos << " fallos";
+    std::cout << "." << std::endl;
+}
@@ -0,0 +1,93 @@
+#ifndef RESULTEXPORTER_H
+#define RESULTEXPORTER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "ContourExtractor.h"
+
+// Formato de las imágenes exportadas
+enum FormatoExportacion {
+    EXPORT_PNG = 0,   // Sin pérdida, comprimido (nivel configurable)
+    EXPORT_BMP,       // Sin compresión: codificación casi gratuita, 3-5x más bytes
+    EXPORT_RAW        // Volcado binario de los píxeles (dimensiones en el nombre del archivo)
+};
+
+struct ConfiguracionExportacion {
+    std::string carpeta = "Resultados_Output";
+    int formato = EXPORT_PNG;
+    int nivelPNG = 1;             // 0 (sin compresión) .. 9 (máxima y lenta)
+    int hilos = 2;                // Escritores en segundo plano
+    size_t maxPendientes = 256;   // Imágenes en cola antes de aplicar contrapresión
+};
+
+// Exportación asíncrona: las vistas de cada corte se encolan y un pool de hilos las
+// codifica y escribe en disco. El llamador (la GUI o el modo lote) no espera a la escritura.
+class ResultExporter {
+public:
+    explicit ResultExporter(const ConfiguracionExportacion& config = ConfiguracionExportacion());
+    ~ResultExporter();   // Termina de escribir lo pendiente
+
+    // Encola las 4 vistas de un corte (mismos nombres que guardarResultados).
+    // 'copiar': copia profunda de las imágenes (la GUI reutiliza sus buffers entre fotogramas).
+    // 'esperarSiLleno': con la cola llena espera (modo lote) o devuelve false sin bloquear (GUI).
+    bool encolar(const std::string& nombreBase, const cv::Mat& orig, const cv::Mat& proc,
+                 const cv::Mat& mask, const cv::Mat& final, bool copiar, bool esperarSiLleno);
+    // Encola los contornos vectoriales de un corte (<nombre>_5_Contornos.json), con la misma
+    // contrapresión que las imágenes. 'indice' y 'archivo' identifican el corte en la serie.
+    bool encolarContornos(const std::string& nombreBase, const ContornosCorte& contornos, int indice,
+                          const std::string& archivo, const double espaciado[3],
+                          const std::string& etiqueta, bool esperarSiLleno);
+
+    // Bloquea hasta que todo lo encolado esté en disco
+    void esperar();
+
+    size_t pendientes() const;
+    void imprimirResumen() const;
+
+    // mkdir -p sin lanzar un shell
+    static bool crearDirectorios(const std::string& ruta);
+    // "png" | "bmp" | "raw" -> FormatoExportacion (-1 si no se reconoce)
+    static int formatoDesdeTexto(const std::string& texto);
+    // Texto listo para ir entre comillas en un JSON (escapa comillas, barras y controles)
+    static std::string escaparJSON(const std::string& texto);
+
+private:
+    struct Trabajo {
+        std::string rutaBase;   // Sin extensión
+        cv::Mat imagen;
+        // Trabajo de contornos (imagen vacía): JSON de un solo corte
+        bool esContornos = false;
+        ContornosCorte contornos;
+        int indice = 0;
+        std::string archivo, etiqueta;
+        double espaciado[3] = {1.0, 1.0, 1.0};
+    };
+
+    void escritor();
+    bool escribir(const Trabajo& t, size_t& bytes);
+    bool esperarHueco(std::unique_lock<std::mutex>& lock, size_t n, bool esperarSiLleno);
+
+    ConfiguracionExportacion config;
+    std::deque<Trabajo> cola;
+    mutable std::mutex mtx;
+    std::condition_variable hayTrabajo, hayEspacio, sinPendientes;
+    size_t enCurso = 0;
+    bool terminar = false;
+    std::vector<std::thread> hilos;
+
+    // Estadísticas de rendimiento
+    size_t imagenesEscritas = 0;
+    size_t contornosEscritos = 0;
+    size_t fallos = 0;
+    unsigned long long bytesEscritos = 0;
+    int64 inicioRafaga = 0;          // Momento en que la cola pasó de vacía a ocupada
+    double segundosActivo = 0.0;     // Tiempo de pared con escrituras en marcha
+    double segundosEscritores = 0.0; // Suma del tiempo de todos los escritores
+};
+
+#endif
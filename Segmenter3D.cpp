@@ -0,0 +1,271 @@
+#include "Segmenter3D.h"
+#include "ImageProcessor.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <climits>
+#include <iostream>
+
+// --- UNION-FIND ---
+// La raíz de cada conjunto es siempre su etiqueta más pequeña: así el compactado
+// final puede hacerse en una sola pasada en orden creciente.
+static inline int raiz(std::vector<int>& padre, int x) {
+    while (padre[x] != x) {
+        padre[x] = padre[padre[x]]; // Compresión de camino (halving)
+        x = padre[x];
+    }
+    return x;
+}
+
+static inline void unir(std::vector<int>& padre, int a, int b) {
+    a = raiz(padre, a);
+    b = raiz(padre, b);
+    if (a < b) padre[b] = a;
+    else if (b < a) padre[a] = b;
+}
+
+Etiquetado3D Segmenter3D::etiquetar(const cv::Mat& mascara, int numCortes, const double espaciado[3]) {
+    CV_Assert(mascara.type() == CV_8UC1 && mascara.isContinuous());
+    CV_Assert(numCortes > 0 && mascara.rows % numCortes == 0);
+    const int alto = mascara.rows / numCortes;
+    const int ancho = mascara.cols;
+    const size_t porCorte = (size_t)alto * ancho;
+
+    Etiquetado3D res;
+    res.etiquetas.create(mascara.size(), CV_32SC1);
+
+    // 1. Bloques de cortes consecutivos (cada uno cabe mejor en caché que el volumen entero)
+    int numBloques = std::min(numCortes, std::max(1, cv::getNumThreads() * 2));
+    std::vector<int> inicio(numBloques + 1);
+    for (int b = 0; b <= numBloques; b++) inicio[b] = (int)((long long)numCortes * b / numBloques);
+    std::vector<std::vector<int>> padres(numBloques);
+
+    // 2. Etiquetado provisional de cada bloque en paralelo (vecinos x-1, y-1, z-1)
+    cv::parallel_for_(cv::Range(0, numBloques), [&](const cv::Range& rango) {
+        for (int b = rango.start; b < rango.end; b++) {
+            std::vector<int>& padre = padres[b];
+            padre.assign(1, 0); // Etiqueta 0 = fondo
+
+            for (int z = inicio[b]; z < inicio[b + 1]; z++) {
+                for (int y = 0; y < alto; y++) {
+                    const uchar* m = mascara.ptr<uchar>(z * alto + y);
+                    int* e = res.etiquetas.ptr<int>(z * alto + y);
+                    const int* eArriba = (y > 0) ? e - ancho : nullptr;
+                    const int* eAtras = (z > inicio[b]) ? e - porCorte : nullptr;
+
+                    for (int x = 0; x < ancho; x++) {
+                        if (!m[x]) { e[x] = 0; continue; }
+
+                        int vecinos[3] = { x > 0 ? e[x - 1] : 0,
+                                           eArriba ? eArriba[x] : 0,
+                                           eAtras ? eAtras[x] : 0 };
+                        int l = 0;
+                        for (int v : vecinos) if (v && (l == 0 || v < l)) l = v;
+
+                        if (l == 0) {
+                            l = (int)padre.size();
+                            padre.push_back(l);
+                        } else {
+                            for (int v : vecinos) if (v && v != l) unir(padre, l, v);
+                        }
+                        e[x] = l;
+                    }
+                }
+            }
+        }
+    });
+
+    // 3. Pasar las etiquetas locales a un espacio global (desplazamiento por bloque)
+    std::vector<int> desplaz(numBloques + 1, 0);
+    for (int b = 0; b < numBloques; b++) desplaz[b + 1] = desplaz[b] + (int)padres[b].size() - 1;
+    std::vector<int> global(desplaz[numBloques] + 1);
+    global[0] = 0;
+
+    cv::parallel_for_(cv::Range(0, numBloques), [&](const cv::Range& rango) {
+        for (int b = rango.start; b < rango.end; b++) {
+            const int d = desplaz[b];
+            for (int l = 1; l < (int)padres[b].size(); l++) global[d + l] = d + raiz(padres[b], l);
+            if (d == 0) continue;
+
+            for (int fila = inicio[b] * alto; fila < inicio[b + 1] * alto; fila++) {
+                int* e = res.etiquetas.ptr<int>(fila);
+                for (int x = 0; x < ancho; x++) if (e[x]) e[x] += d;
+            }
+        }
+    });
+
+    // 4. Fusionar las fronteras entre bloques (solo numBloques-1 planos)
+    for (int b = 1; b < numBloques; b++) {
+        const int* actual = res.etiquetas.ptr<int>(inicio[b] * alto);
+        const int* previo = actual - porCorte;
+        for (size_t i = 0; i < porCorte; i++) {
+            if (actual[i] && previo[i]) unir(global, actual[i], previo[i]);
+        }
+    }
+
+    // 5. Compactar a etiquetas consecutivas 1..K
+    std::vector<int> final(global.size(), 0);
+    int K = 0;
+    for (int l = 1; l < (int)global.size(); l++) {
+        int r = raiz(global, l);
+        final[l] = (r == l) ? ++K : final[r];
+    }
+
+    cv::parallel_for_(cv::Range(0, res.etiquetas.rows), [&](const cv::Range& filas) {
+        for (int fila = filas.start; fila < filas.end; fila++) {
+            int* e = res.etiquetas.ptr<int>(fila);
+            for (int x = 0; x < ancho; x++) e[x] = final[e[x]];
+        }
+    });
+
+    // 6. Estadísticas por componente: voxeles, volumen y contacto con el borde X/Y
+    res.componentes.resize(K);
+    for (int k = 0; k < K; k++) res.componentes[k].etiqueta = k + 1;
+
+    const int* e = res.etiquetas.ptr<int>(0);
+    const size_t total = res.etiquetas.total();
+    for (size_t i = 0; i < total; i++) {
+        if (e[i]) res.componentes[e[i] - 1].voxeles++;
+    }
+    for (int fila = 0; fila < res.etiquetas.rows; fila++) {
+        const int* f = res.etiquetas.ptr<int>(fila);
+        int y = fila % alto;
+        if (y == 0 || y == alto - 1) {
+            for (int x = 0; x < ancho; x++) if (f[x]) res.componentes[f[x] - 1].tocaBorde = true;
+        } else {
+            if (f[0]) res.componentes[f[0] - 1].tocaBorde = true;
+            if (f[ancho - 1]) res.componentes[f[ancho - 1] - 1].tocaBorde = true;
+        }
+    }
+
+    const double mlPorVoxel = espaciado[0] * espaciado[1] * espaciado[2] / 1000.0;
+    for (auto& c : res.componentes) c.volumenML = c.voxeles * mlPorVoxel;
+    return res;
+}
+
+cv::Mat Segmenter3D::mascaraDesdeEtiquetas(const Etiquetado3D& etiquetado, const std::vector<char>& conservar) {
+    cv::Mat salida(etiquetado.etiquetas.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, salida.rows), [&](const cv::Range& filas) {
+        for (int fila = filas.start; fila < filas.end; fila++) {
+            const int* e = etiquetado.etiquetas.ptr<int>(fila);
+            uchar* m = salida.ptr<uchar>(fila);
+            for (int x = 0; x < salida.cols; x++) m[x] = conservar[e[x]] ? 255 : 0;
+        }
+    });
+    return salida;
+}
+
+cv::Mat Segmenter3D::seleccionarMayores(const Etiquetado3D& etiquetado, int cuantas, bool excluirBorde) {
+    std::vector<Componente3D> candidatas;
+    for (const auto& c : etiquetado.componentes) {
+        if (!(excluirBorde && c.tocaBorde)) candidatas.push_back(c);
+    }
+    std::sort(candidatas.begin(), candidatas.end(),
+              [](const Componente3D& a, const Componente3D& b) { return a.voxeles > b.voxeles; });
+    if ((int)candidatas.size() > cuantas) candidatas.resize(cuantas);
+
+    std::vector<char> conservar(etiquetado.componentes.size() + 1, 0);
+    for (const auto& c : candidatas) conservar[c.etiqueta] = 1;
+    ultimas = candidatas;
+    return mascaraDesdeEtiquetas(etiquetado, conservar);
+}
+
+cv::Mat Segmenter3D::filtrarPorVolumen(const Etiquetado3D& etiquetado, double minML) {
+    std::vector<char> conservar(etiquetado.componentes.size() + 1, 0);
+    ultimas.clear();
+    for (const auto& c : etiquetado.componentes) {
+        if (c.volumenML >= minML) {
+            conservar[c.etiqueta] = 1;
+            ultimas.push_back(c);
+        }
+    }
+    std::sort(ultimas.begin(), ultimas.end(),
+              [](const Componente3D& a, const Componente3D& b) { return a.voxeles > b.voxeles; });
+    return mascaraDesdeEtiquetas(etiquetado, conservar);
+}
+
+// --- MORFOLOGÍA 3D ---
+// Elemento cúbico 3x3x3 separable: 3x3 dentro de cada corte + mínimo/máximo entre cortes vecinos.
+void Segmenter3D::dilatarOErosionar3D(const cv::Mat& entrada, cv::Mat& salida, int numCortes, bool dilatar) {
+    const int alto = entrada.rows / numCortes;
+    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+
+    // 1. Pasada en el plano (BORDER_ISOLATED: cada corte no debe ver las filas del vecino)
+    cv::Mat plano(entrada.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, numCortes), [&](const cv::Range& rango) {
+        for (int z = rango.start; z < rango.end; z++) {
+            cv::Mat src = entrada.rowRange(z * alto, (z + 1) * alto);
+            cv::Mat dst = plano.rowRange(z * alto, (z + 1) * alto);
+            int borde = cv::BORDER_CONSTANT | cv::BORDER_ISOLATED;
+            if (dilatar) cv::dilate(src, dst, kernel, cv::Point(-1, -1), 1, borde);
+            else cv::erode(src, dst, kernel, cv::Point(-1, -1), 1, borde);
+        }
+    });
+
+    // 2. Pasada entre cortes (fuera del volumen no se considera)
+    salida.create(entrada.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, numCortes), [&](const cv::Range& rango) {
+        for (int z = rango.start; z < rango.end; z++) {
+            cv::Mat dst = salida.rowRange(z * alto, (z + 1) * alto);
+            plano.rowRange(z * alto, (z + 1) * alto).copyTo(dst);
+            for (int dz = -1; dz <= 1; dz += 2) {
+                int zv = z + dz;
+                if (zv < 0 || zv >= numCortes) continue;
+                cv::Mat vecino = plano.rowRange(zv * alto, (zv + 1) * alto);
+                if (dilatar) cv::max(dst, vecino, dst);
+                else cv::min(dst, vecino, dst);
+            }
+        }
+    });
+}
+
+void Segmenter3D::morfologia3D(cv::Mat& mascara, int numCortes, int operacion) {
+    cv::Mat tmp;
+    if (operacion == cv::MORPH_OPEN) {
+        dilatarOErosionar3D(mascara, tmp, numCortes, false);
+        dilatarOErosionar3D(tmp, mascara, numCortes, true);
+    } else if (operacion == cv::MORPH_CLOSE) {
+        dilatarOErosionar3D(mascara, tmp, numCortes, true);
+        dilatarOErosionar3D(tmp, mascara, numCortes, false);
+    }
+}
+
+// --- PRESETS VOLUMÉTRICOS ---
+
+cv::Mat Segmenter3D::segmentarPulmon3D(const VolumenCT& volumen, bool usarMorf) {
+    TemporizadorEtapa tiempo(PERF_SEGMENTACION_3D);
+    cv::Mat mascara;
+    cv::inRange(volumen.datos, cv::Scalar(SHRT_MIN), cv::Scalar(HU_PULMON_MAX), mascara);
+    if (usarMorf) morfologia3D(mascara, volumen.numCortes, cv::MORPH_OPEN);
+
+    // El aire exterior toca el borde del volumen: los dos pulmones son las dos
+    // componentes interiores más grandes
+    Etiquetado3D et = etiquetar(mascara, volumen.numCortes, volumen.espaciado);
+    cv::Mat pulmones = seleccionarMayores(et, 2, true);
+
+    // Cierre para rellenar vasos y bronquios dentro del parénquima
+    if (usarMorf) morfologia3D(pulmones, volumen.numCortes, cv::MORPH_CLOSE);
+    return pulmones;
+}
+
+cv::Mat Segmenter3D::segmentarHueso3D(const VolumenCT& volumen, bool usarMorf) {
+    TemporizadorEtapa tiempo(PERF_SEGMENTACION_3D);
+    cv::Mat mascara;
+    cv::inRange(volumen.datos, cv::Scalar(HU_HUESO_MIN), cv::Scalar(SHRT_MAX), mascara);
+    if (usarMorf) morfologia3D(mascara, volumen.numCortes, cv::MORPH_CLOSE);
+
+    // El esqueleto no es una sola pieza: se descartan solo las componentes
+    // pequeñas (calcificaciones, contraste, ruido)
+    Etiquetado3D et = etiquetar(mascara, volumen.numCortes, volumen.espaciado);
+    return filtrarPorVolumen(et, 0.5);
+}
+
+void Segmenter3D::imprimirResumen(const std::string& titulo, size_t maxComponentes) const {
+    double totalML = 0;
+    for (const auto& c : ultimas) totalML += c.volumenML;
+    std::cout << "[3D] " << titulo << ": " << ultimas.size() << " componentes, "
+              << totalML << " mL en total." << std::endl;
+    for (size_t i = 0; i < ultimas.size() && i < maxComponentes; i++) {
+        std::cout << "     #" << (i + 1) << "  " << ultimas[i].voxeles << " voxeles  "
+                  << ultimas[i].volumenML << " mL" << std::endl;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef SEGMENTER3D_H
+#define SEGMENTER3D_H
+
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "DicomHandler.h"
+
+// Una componente conexa 3D del etiquetado
+struct Componente3D {
+    int etiqueta = 0;
+    long long voxeles = 0;
+    double volumenML = 0.0;
+    bool tocaBorde = false;    // Toca el borde X/Y del volumen (p.ej. aire fuera del paciente)
+};
+
+// Resultado del etiquetado: misma disposición apilada que VolumenCT ((Z*alto) x ancho)
+struct Etiquetado3D {
+    cv::Mat etiquetas;                      // CV_32S, 0 = fondo, 1..N = componente
+    std::vector<Componente3D> componentes;  // componentes[i].etiqueta == i + 1
+};
+
+// Segmentación volumétrica: componentes conexas 3D (6-conectividad) y morfología 3D.
+// El etiquetado divide el volumen en bloques de cortes que se etiquetan en paralelo
+// con union-find local; después se fusionan las fronteras entre bloques.
+class Segmenter3D {
+public:
+    Etiquetado3D etiquetar(const cv::Mat& mascara, int numCortes, const double espaciado[3]);
+
+    // Máscara con las 'cuantas' componentes más grandes (opcionalmente ignorando las del borde)
+    cv::Mat seleccionarMayores(const Etiquetado3D& etiquetado, int cuantas, bool excluirBorde);
+
+    // Máscara con las componentes de al menos 'minML' mililitros
+    cv::Mat filtrarPorVolumen(const Etiquetado3D& etiquetado, double minML);
+
+    // Apertura/Cierre 3D con elemento cúbico de 3x3x3 (cv::MORPH_OPEN / cv::MORPH_CLOSE)
+    void morfologia3D(cv::Mat& mascara, int numCortes, int operacion);
+
+    // --- PRESETS VOLUMÉTRICOS ---
+    cv::Mat segmentarPulmon3D(const VolumenCT& volumen, bool usarMorf);
+    cv::Mat segmentarHueso3D(const VolumenCT& volumen, bool usarMorf);
+
+    // Resumen de las componentes más grandes del último preset (voxeles y mL)
+    const std::vector<Componente3D>& ultimasComponentes() const { return ultimas; }
+    void imprimirResumen(const std::string& titulo, size_t maxComponentes = 5) const;
+
+private:
+    void dilatarOErosionar3D(const cv::Mat& entrada, cv::Mat& salida, int numCortes, bool dilatar);
+    cv::Mat mascaraDesdeEtiquetas(const Etiquetado3D& etiquetado, const std::vector<char>& conservar);
+
+    std::vector<Componente3D> ultimas;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "SliceCache.h"
+#include "DicomHandler.h"
+
+// --- CACHÉ LRU ---
+
+static size_t bytesDe(const cv::Mat& img) {
+    return img.total() * img.elemSize();
+}
+
+SliceCache::SliceCache(size_t presupuestoBytes) : presupuesto(presupuestoBytes) {}
+
+bool SliceCache::obtener(int indice, cv::Mat& salida) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = mapa.find(indice);
+    if (it == mapa.end()) return false;
+
+    // Mover al frente (recién usado)
+    orden.splice(orden.begin(), orden, it->second);
+    salida = it->second->second;
+    return true;
+}
+
+void SliceCache::insertar(int indice, const cv::Mat& img) {
+    if (img.empty()) return;
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = mapa.find(indice);
+    if (it != mapa.end()) {
+        usados -= bytesDe(it->second->second);
+        orden.erase(it->second);
+        mapa.erase(it);
+    }
+    orden.emplace_front(indice, img);
+    mapa[indice] = orden.begin();
+    usados += bytesDe(img);
+    recortar();
+}
+
+bool SliceCache::contiene(int indice) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return mapa.count(indice) > 0;
+}
+
+void SliceCache::setPresupuesto(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    presupuesto = bytes;
+    recortar();
+}
+
+size_t SliceCache::bytesUsados() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return usados;
+}
+
+void SliceCache::recortar() {
+    // Siempre conservamos al menos el corte más reciente (el que se está viendo)
+    while (usados > presupuesto && orden.size() > 1) {
+        usados -= bytesDe(orden.back().second);
+        mapa.erase(orden.back().first);
+        orden.pop_back();
+    }
+}
+
+// --- PRECARGA EN SEGUNDO PLANO ---
+
+SlicePrefetcher::SlicePrefetcher(const std::vector<std::string>& archivos, SliceCache& cache, int radio)
+    : archivos(archivos), cache(cache), radio(radio) {
+    hilo = std::thread(&SlicePrefetcher::bucleCarga, this);
+}
+
+SlicePrefetcher::~SlicePrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        salir = true;
+        pendientes.clear();
+    }
+    cvCola.notify_all();
+    if (hilo.joinable()) hilo.join();
+}
+
+cv::Mat SlicePrefetcher::obtener(int indice) {
+    cv::Mat img;
+    if (!cache.obtener(indice, img)) {
+        std::unique_lock<std::mutex> lock(mtx);
+        // Si el hilo ya lo está decodificando, esperamos a que termine en vez de repetirlo
+        cvCola.wait(lock, [&] { return enCarga != indice; });
+        lock.unlock();
+
+        if (!cache.obtener(indice, img)) {
+            DicomHandler dicomIO;
+            img = dicomIO.cargarImagenDicom(archivos[indice]);
+            cache.insertar(indice, img);
+        }
+    }
+    enfocar(indice);
+    return img;
+}
+
+void SlicePrefetcher::enfocar(int indice) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        pendientes.clear();
+        // Orden de prioridad: siguiente, anterior, +2, -2, ...
+        for (int d = 1; d <= radio; d++) {
+            if (indice + d < (int)archivos.size()) pendientes.push_back(indice + d);
+            if (indice - d >= 0) pendientes.push_back(indice - d);
+        }
+    }
+    cvCola.notify_all();
+}
+
+void SlicePrefetcher::bucleCarga() {
+    DicomHandler dicomIO;
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        cvCola.wait(lock, [&] { return salir || !pendientes.empty(); });
+        if (salir) break;
+
+        int indice = pendientes.front();
+        pendientes.pop_front();
+        if (cache.contiene(indice)) continue;
+
+        enCarga = indice;
+        lock.unlock();
+        cv::Mat img = dicomIO.cargarImagenDicom(archivos[indice]);
+        cache.insertar(indice, img);
+        lock.lock();
+        enCarga = -1;
+        cvCola.notify_all();
+    }
+}
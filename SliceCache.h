@@ -0,0 +1,69 @@
+#ifndef SLICECACHE_H
+#define SLICECACHE_H
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Caché LRU de cortes decodificados, acotada por un presupuesto de memoria (bytes).
+// Es segura entre hilos: la usan a la vez la GUI y el cargador en segundo plano.
+class SliceCache {
+public:
+    explicit SliceCache(size_t presupuestoBytes = 256u * 1024u * 1024u);
+
+    // Devuelve true si el corte estaba en caché (y lo marca como recién usado)
+    bool obtener(int indice, cv::Mat& salida);
+    void insertar(int indice, const cv::Mat& img);
+    bool contiene(int indice) const;
+
+    void setPresupuesto(size_t bytes);
+    size_t bytesUsados() const;
+
+private:
+    using Entrada = std::pair<int, cv::Mat>;
+
+    // Expulsa los cortes menos usados hasta volver a caber en el presupuesto
+    void recortar();
+
+    mutable std::mutex mtx;
+    size_t presupuesto;
+    size_t usados = 0;
+    std::list<Entrada> orden;   // Frente = más reciente
+    std::unordered_map<int, std::list<Entrada>::iterator> mapa;
+};
+
+// Cargador asíncrono: decodifica en un hilo propio los N cortes anteriores y
+// siguientes al actual, para que la navegación no espere al disco ni a ITK.
+class SlicePrefetcher {
+public:
+    SlicePrefetcher(const std::vector<std::string>& archivos, SliceCache& cache, int radio = 4);
+    ~SlicePrefetcher();
+
+    // Devuelve el corte pedido; solo bloquea si no estaba ya en caché
+    cv::Mat obtener(int indice);
+
+    // Reordena la cola de precarga alrededor del corte actual
+    void enfocar(int indice);
+
+private:
+    void bucleCarga();
+
+    std::vector<std::string> archivos;
+    SliceCache& cache;
+    int radio;
+
+    std::mutex mtx;
+    std::condition_variable cvCola;
+    std::deque<int> pendientes;
+    int enCarga = -1;   // Corte que el hilo está decodificando ahora mismo
+    bool salir = false;
+    std::thread hilo;
+};
+
+#endif
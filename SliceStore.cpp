@@ -0,0 +1,280 @@
+#include "SliceStore.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const int TAM_BLOQUE = 32;   // Diferencias por bloque empaquetado (32*bits es múltiplo de 32)
+
+inline uint16_t zigzag(uint16_t diferencia) {
+    return (uint16_t)((diferencia << 1) ^ (uint16_t)((int16_t)diferencia >> 15));
+}
+
+inline uint16_t desZigzag(uint16_t z) {
+    return (uint16_t)((z >> 1) ^ (uint16_t)-(int16_t)(z & 1));
+}
+
+inline int bitsNecesarios(uint16_t valor) {
+    int bits = 0;
+    while (valor) { bits++; valor >>= 1; }
+    return bits;
+}
+
+// Empaqueta 32 valores de 'bits' bits (palabras de 32 bits, little-endian)
+uint8_t* empaquetar(const uint16_t* v, int bits, uint8_t* o) {
+    uint64_t acumulado = 0;
+    int llenos = 0;
+    for (int k = 0; k < TAM_BLOQUE; k++) {
+        acumulado |= (uint64_t)v[k] << llenos;
+        llenos += bits;
+        if (llenos >= 32) {
+            uint32_t palabra = (uint32_t)acumulado;
+            std::memcpy(o, &palabra, 4);
+            o += 4;
+            acumulado >>= 32;
+            llenos -= 32;
+        }
+    }
+    return o;
+}
+
+const uint8_t* desempaquetar(const uint8_t* in, int bits, uint16_t* v) {
+    if (bits == 0) {
+        std::memset(v, 0, TAM_BLOQUE * sizeof(uint16_t));
+        return in;
+    }
+    const uint64_t mascara = (1u << bits) - 1;
+    uint64_t acumulado = 0;
+    int llenos = 0;
+    for (int k = 0; k < TAM_BLOQUE; k++) {
+        if (llenos < bits) {
+            uint32_t palabra;
+            std::memcpy(&palabra, in, 4);
+            in += 4;
+            acumulado |= (uint64_t)palabra << llenos;
+            llenos += 32;
+        }
+        v[k] = (uint16_t)(acumulado & mascara);
+        acumulado >>= bits;
+        llenos -= bits;
+    }
+    return in;
+}
+
+inline void escribirVarint(size_t valor, std::vector<uint8_t>& salida) {
+    while (valor >= 0x80) {
+        salida.push_back((uint8_t)(valor | 0x80));
+        valor >>= 7;
+    }
+    salida.push_back((uint8_t)valor);
+}
+
+} // namespace
+
+void SliceStore::reiniciar(int numCortes, int alto, int ancho) {
+    filas = alto;
+    columnas = ancho;
+    cortes.assign(numCortes, std::vector<uint8_t>());
+    mascaras.assign(numCortes, std::vector<uint8_t>());
+}
+
+// --- CÓDEC DE HU: DIFERENCIAS + EMPAQUETADO POR BLOQUES ---
+
+void SliceStore::comprimirHU(const cv::Mat& hu, std::vector<uint8_t>& salida) {
+    CV_Assert(hu.type() == CV_16SC1);
+    const int alto = hu.rows, ancho = hu.cols;
+    const size_t n = (size_t)alto * ancho;
+    const size_t bloques = (n + TAM_BLOQUE - 1) / TAM_BLOQUE;
+
+    // 1. Diferencias en zigzag (el último bloque se rellena con ceros)
+    std::vector<uint16_t> residuos(bloques * TAM_BLOQUE, 0);
+    for (int y = 0; y < alto; y++) {
+        const uint16_t* p = hu.ptr<uint16_t>(y);
+        uint16_t* r = &residuos[(size_t)y * ancho];
+        r[0] = zigzag((uint16_t)(p[0] - (y > 0 ? hu.ptr<uint16_t>(y - 1)[0] : 0)));
+        for (int x = 1; x < ancho; x++) r[x] = zigzag((uint16_t)(p[x] - p[x - 1]));
+    }
+
+    // 2. Cada bloque: 1 byte con los bits y 4*bits bytes de datos
+    salida.resize(bloques * (1 + TAM_BLOQUE * sizeof(uint16_t)));
+    uint8_t* o = salida.data();
+    for (size_t b = 0; b < bloques; b++) {
+        const uint16_t* v = &residuos[b * TAM_BLOQUE];
+        uint16_t unionBits = 0;
+        for (int k = 0; k < TAM_BLOQUE; k++) unionBits |= v[k];
+        int bits = bitsNecesarios(unionBits);
+        *o++ = (uint8_t)bits;
+        if (bits > 0) o = empaquetar(v, bits, o);
+    }
+    salida.resize(o - salida.data());
+}
+
+void SliceStore::descomprimirHU(const std::vector<uint8_t>& datos, int alto, int ancho, cv::Mat& salida) {
+    if (!salida.isContinuous()) salida.release();
+    salida.create(alto, ancho, CV_16SC1);
+    const size_t n = (size_t)alto * ancho;
+    const size_t bloquesCompletos = n / TAM_BLOQUE;
+
+    // 1. Los residuos se desempaquetan directamente en la salida (continua)...
+    uint16_t* r = salida.ptr<uint16_t>(0);
+    const uint8_t* in = datos.data();
+    for (size_t b = 0; b < bloquesCompletos; b++) {
+        int bits = *in++;
+        in = desempaquetar(in, bits, r + b * TAM_BLOQUE);
+    }
+    if (n % TAM_BLOQUE) {
+        uint16_t resto[TAM_BLOQUE];
+        int bits = *in++;
+        desempaquetar(in, bits, resto);
+        std::memcpy(r + bloquesCompletos * TAM_BLOQUE, resto, (n % TAM_BLOQUE) * sizeof(uint16_t));
+    }
+
+    // 2. ... y se reconstruyen en el mismo sitio con la suma acumulada de cada fila
+    for (int y = 0; y < alto; y++) {
+        uint16_t* p = salida.ptr<uint16_t>(y);
+        uint16_t previo = y > 0 ? salida.ptr<uint16_t>(y - 1)[0] : 0;
+        for (int x = 0; x < ancho; x++) {
+            previo = (uint16_t)(previo + desZigzag(p[x]));
+            p[x] = previo;
+        }
+    }
+}
+
+// --- CÓDEC DE MÁSCARAS: RACHAS ---
+
+void SliceStore::comprimirMascara(const cv::Mat& mascara, std::vector<uint8_t>& salida) {
+    CV_Assert(mascara.type() == CV_8UC1);
+    salida.clear();
+    // Rachas alternas empezando por el fondo (la primera puede medir 0)
+    bool dentro = false;
+    size_t racha = 0;
+    for (int y = 0; y < mascara.rows; y++) {
+        const uchar* m = mascara.ptr<uchar>(y);
+        for (int x = 0; x < mascara.cols; x++) {
+            if ((m[x] != 0) != dentro) {
+                escribirVarint(racha, salida);
+                dentro = !dentro;
+                racha = 0;
+            }
+            racha++;
+        }
+    }
+    escribirVarint(racha, salida);
+}
+
+void SliceStore::descomprimirMascara(const std::vector<uint8_t>& datos, int alto, int ancho, cv::Mat& salida) {
+    if (!salida.isContinuous()) salida.release();
+    salida.create(alto, ancho, CV_8UC1);
+    uchar* o = salida.ptr<uchar>(0);
+    const size_t n = (size_t)alto * ancho;
+    size_t pos = 0;
+    bool dentro = false;
+    for (size_t i = 0; i < datos.size() && pos < n;) {
+        size_t racha = 0;
+        int desplazamiento = 0;
+        uint8_t byte;
+        do {
+            byte = datos[i++];
+            racha |= (size_t)(byte & 0x7F) << desplazamiento;
+            desplazamiento += 7;
+        } while ((byte & 0x80) && i < datos.size());
+        racha = std::min(racha, n - pos);
+        std::memset(o + pos, dentro ? 255 : 0, racha);
+        pos += racha;
+        dentro = !dentro;
+    }
+    if (pos < n) std::memset(o + pos, 0, n - pos);   // Datos truncados: el resto es fondo
+}
+
+// --- ALMACÉN ---
+
+void SliceStore::guardarCorte(int z, const cv::Mat& hu) {
+    CV_Assert(z >= 0 && z < numCortes() && hu.rows == filas && hu.cols == columnas);
+    std::vector<uint8_t> buffer;
+    comprimirHU(hu, buffer);
+    // Copia del tamaño justo: el buffer de trabajo reserva para el peor caso
+    cortes[z] = std::vector<uint8_t>(buffer.begin(), buffer.end());
+}
+
+void SliceStore::guardarMascara(int z, const cv::Mat& mascara) {
+    CV_Assert(z >= 0 && z < numCortes() && mascara.rows == filas && mascara.cols == columnas);
+    std::vector<uint8_t> buffer;
+    comprimirMascara(mascara, buffer);
+    mascaras[z] = std::vector<uint8_t>(buffer.begin(), buffer.end());
+}
+
+void SliceStore::guardarVolumen(const cv::Mat& datos) {
+    CV_Assert(datos.rows == numCortes() * filas);
+    cv::parallel_for_(cv::Range(0, numCortes()), [&](const cv::Range& rango) {
+        for (int z = rango.start; z < rango.end; z++) guardarCorte(z, datos.rowRange(z * filas, (z + 1) * filas));
+    });
+}
+
+void SliceStore::guardarMascaras(const cv::Mat& volumenMascara) {
+    CV_Assert(volumenMascara.rows == numCortes() * filas);
+    cv::parallel_for_(cv::Range(0, numCortes()), [&](const cv::Range& rango) {
+        for (int z = rango.start; z < rango.end; z++) {
+            guardarMascara(z, volumenMascara.rowRange(z * filas, (z + 1) * filas));
+        }
+    });
+}
+
+cv::Mat SliceStore::obtenerCorte(int z) const {
+    cv::Mat salida;
+    obtenerCorte(z, salida);
+    return salida;
+}
+
+bool SliceStore::obtenerCorte(int z, cv::Mat& salida) const {
+    if (!tieneCorte(z)) return false;
+    TemporizadorEtapa tiempo(PERF_DESCOMPRIMIR);
+    descomprimirHU(cortes[z], filas, columnas, salida);
+    return true;
+}
+
+cv::Mat SliceStore::obtenerMascara(int z) const {
+    cv::Mat salida;
+    obtenerMascara(z, salida);
+    return salida;
+}
+
+bool SliceStore::obtenerMascara(int z, cv::Mat& salida) const {
+    if (!tieneMascara(z)) return false;
+    descomprimirMascara(mascaras[z], filas, columnas, salida);
+    return true;
+}
+
+cv::Mat SliceStore::obtenerVolumen() const {
+    cv::Mat datos(numCortes() * filas, columnas, CV_16SC1, cv::Scalar(0));
+    cv::parallel_for_(cv::Range(0, numCortes()), [&](const cv::Range& rango) {
+        for (int z = rango.start; z < rango.end; z++) {
+            if (!tieneCorte(z)) continue;
+            cv::Mat destino = datos.rowRange(z * filas, (z + 1) * filas);
+            descomprimirHU(cortes[z], filas, columnas, destino);
+        }
+    });
+    return datos;
+}
+
+size_t SliceStore::bytesComprimidos() const {
+    size_t total = 0;
+    for (const auto& c : cortes) total += c.size();
+    for (const auto& m : mascaras) total += m.size();
+    return total;
+}
+
+size_t SliceStore::bytesOriginales() const {
+    size_t pixeles = (size_t)filas * columnas, total = 0;
+    for (const auto& c : cortes) if (!c.empty()) total += pixeles * sizeof(int16_t);
+    for (const auto& m : mascaras) if (!m.empty()) total += pixeles;
+    return total;
+}
+
+void SliceStore::imprimirResumen(const std::string& nombre) const {
+    size_t comprimidos = bytesComprimidos(), originales = bytesOriginales();
+    std::cout << "[MEMORIA] " << nombre << ": " << originales / (1024.0 * 1024.0) << " MB -> "
+              << comprimidos / (1024.0 * 1024.0) << " MB comprimidos (x"
+              << (comprimidos > 0 ? (double)originales / comprimidos : 0.0) << ")." << std::endl;
+}
@@ -0,0 +1,65 @@
+#ifndef SLICESTORE_H
+#define SLICESTORE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Almacén de cortes comprimidos en memoria, sin pérdida y con acceso aleatorio por corte.
+// Para series muy grandes (miles de cortes finos): solo el corte que se usa se descomprime.
+//
+// - HU (CV_16S): cada píxel se predice con el de su izquierda (el primero de la fila, con el
+//   de arriba) y la diferencia se guarda en zigzag (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...).
+//   Las diferencias se agrupan en bloques de 32 que se empaquetan con los bits del mayor
+//   del bloque: el aire exterior ocupa 1 byte por bloque y el tejido con ruido ~7-9 bits
+//   por píxel en lugar de 16. Descomprimir es desempaquetar y una suma acumulada por fila.
+// - Máscaras (CV_8U binarias, 0/255): longitudes de las rachas alternas de 0 y 255 en
+//   enteros de longitud variable (1 byte hasta 127 píxeles). Una máscara de hueso o pulmón
+//   se queda en el ~1% de su tamaño.
+//
+// Guardar cortes distintos desde varios hilos a la vez es seguro; leer un corte mientras
+// otro hilo lo sustituye, no.
+class SliceStore {
+public:
+    void reiniciar(int numCortes, int alto, int ancho);
+
+    int numCortes() const { return (int)cortes.size(); }
+    int alto() const { return filas; }
+    int ancho() const { return columnas; }
+
+    // Comprimen y guardan el corte z (sustituyen el anterior, si lo había)
+    void guardarCorte(int z, const cv::Mat& hu);
+    void guardarMascara(int z, const cv::Mat& mascara);
+    // Todos los cortes de un volumen apilado ((numCortes*alto) x ancho, como VolumenCT::datos), en paralelo
+    void guardarVolumen(const cv::Mat& datos);
+    void guardarMascaras(const cv::Mat& volumenMascara);
+
+    bool tieneCorte(int z) const { return z >= 0 && z < numCortes() && !cortes[z].empty(); }
+    bool tieneMascara(int z) const { return z >= 0 && z < numCortes() && !mascaras[z].empty(); }
+
+    // Descompresión bajo demanda (devuelven false / cv::Mat() si el corte no está guardado)
+    cv::Mat obtenerCorte(int z) const;
+    bool obtenerCorte(int z, cv::Mat& salida) const;
+    cv::Mat obtenerMascara(int z) const;
+    bool obtenerMascara(int z, cv::Mat& salida) const;
+    // Volumen completo descomprimido en paralelo (para la segmentación 3D o las vistas MPR)
+    cv::Mat obtenerVolumen() const;
+
+    size_t bytesComprimidos() const;
+    size_t bytesOriginales() const;   // Lo que ocuparían los mismos cortes sin comprimir
+    void imprimirResumen(const std::string& nombre) const;
+
+    // Códecs de un corte (sin estado)
+    static void comprimirHU(const cv::Mat& hu, std::vector<uint8_t>& salida);
+    static void descomprimirHU(const std::vector<uint8_t>& datos, int alto, int ancho, cv::Mat& salida);
+    static void comprimirMascara(const cv::Mat& mascara, std::vector<uint8_t>& salida);
+    static void descomprimirMascara(const std::vector<uint8_t>& datos, int alto, int ancho, cv::Mat& salida);
+
+private:
+    int filas = 0, columnas = 0;
+    std::vector<std::vector<uint8_t>> cortes;     // Vacío = corte no guardado
+    std::vector<std::vector<uint8_t>> mascaras;
+};
+
+#endif
@@ -0,0 +1,405 @@
+#include "VolumeCache.h"
+#include "DicomHandler.h"
+#include "ItkMatBridge.h"
+#include "ResultExporter.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// --- FORMATO EN DISCO ---
+const char MAGIA[8] = {'I', 'T', 'G', 'V', 'O', 'L', '\0', '\0'};
+const uint32_t VERSION_CACHE = 2;   // 2: huella del filtro en cada capa
+const uint64_t ALINEACION = 4096;
+const int MAX_CAPAS = 16;
+
+struct CapaDisco {
+    int32_t preset;
+    int32_t clahe;
+    uint64_t huellaFiltro;
+    uint64_t offset;
+};
+
+struct CabeceraDisco {
+    char magia[8];
+    uint32_t version;
+    uint32_t bytesPixel;
+    uint64_t huella;
+    int32_t numCortes, alto, ancho, numCapas;
+    double espaciado[3];
+    double pendiente, intercepto, espaciadoX, espaciadoY;
+    uint64_t offsetRutas, bytesRutas;
+    uint64_t offsetVoxeles, bytesVoxeles;
+    CapaDisco capas[MAX_CAPAS];
+};
+static_assert(sizeof(CabeceraDisco) <= ALINEACION, "La cabecera debe caber en un bloque");
+
+uint64_t alinear(uint64_t x) { return (x + ALINEACION - 1) & ~(ALINEACION - 1); }
+
+// Bytes de una capa: validez (alineada) + los cortes de 8 bits
+uint64_t bytesCapa(int numCortes, int alto, int ancho) {
+    return alinear((uint64_t)numCortes) + (uint64_t)numCortes * alto * ancho;
+}
+
+// mmap de [offset, offset + bytes) aunque offset no sea múltiplo de la página del sistema
+uint8_t* mapearRegion(int fd, uint64_t offset, size_t bytes, int proteccion, int flags,
+                      std::shared_ptr<void>& dueno) {
+    uint64_t pagina = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t base = offset - offset % pagina;
+    size_t total = bytes + (size_t)(offset - base);
+    void* p = mmap(nullptr, total, proteccion, flags, fd, (off_t)base);
+    if (p == MAP_FAILED) return nullptr;
+    dueno.reset(p, [total](void* q) { munmap(q, total); });
+    return static_cast<uint8_t*>(p) + (offset - base);
+}
+
+void mezclar(uint64_t& h, const void* datos, size_t n) {
+    const uint8_t* b = static_cast<const uint8_t*>(datos);
+    for (size_t i = 0; i < n; i++) {
+        h ^= b[i];
+        h *= 1099511628211ULL;   // Primo FNV de 64 bits
+    }
+}
+
+// Nombre de la caché: la misma carpeta da el mismo archivo aunque se abra con otra ruta relativa
+std::string rutaEnRaiz(const std::string& raiz, const std::string& carpeta, const std::string& uid) {
+    char absoluta[PATH_MAX];
+    std::string dir = realpath(carpeta.c_str(), absoluta) ? std::string(absoluta) : carpeta;
+    uint64_t h = 14695981039346656037ULL;
+    mezclar(h, dir.data(), dir.size() + 1);
+    mezclar(h, uid.data(), uid.size());
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)h);
+    return raiz + "/" + hex + ".vol";
+}
+
+// realpath de una ruta que puede no existir todavía: se resuelve el ancestro más cercano que
+// exista y se le añade el resto (así comprobar la raíz de caché no crea carpetas)
+std::string rutaAbsoluta(const std::string& ruta) {
+    char absoluta[PATH_MAX];
+    if (realpath(ruta.c_str(), absoluta)) return absoluta;
+    size_t barra = ruta.find_last_of('/');
+    if (barra == std::string::npos) return realpath(".", absoluta) ? std::string(absoluta) + "/" + ruta : "";
+    if (barra == 0) return ruta;
+    std::string padre = rutaAbsoluta(ruta.substr(0, barra));
+    return padre.empty() ? "" : padre + ruta.substr(barra);
+}
+
+} // namespace
+
+VolumeCache::VolumeCache(const std::string& ruta) : rutaArchivo(ruta) {}
+
+VolumeCache::~VolumeCache() { cerrar(); }
+
+std::string VolumeCache::rutaParaCarpeta(const std::string& raiz, const std::string& carpeta) {
+    return rutaEnRaiz(raiz, carpeta, "");
+}
+
+std::string VolumeCache::rutaParaSerie(const std::string& raiz, const SerieDicom& serie) {
+    return rutaEnRaiz(raiz, serie.directorio, serie.unicaEnDirectorio ? "" : serie.uid);
+}
+
+bool VolumeCache::raizDentroDe(const std::string& raiz, const std::string& carpeta) {
+    std::string hija = rutaAbsoluta(raiz), padre = rutaAbsoluta(carpeta);
+    if (hija.empty() || padre.empty()) return false;
+    if (padre.back() != '/') padre += '/';
+    return (hija + '/').compare(0, padre.size(), padre) == 0;
+}
+
+bool VolumeCache::raizPermitida(const std::string& raiz, const std::string& entrada) {
+    if (raiz.empty()) return false;
+    if (!raizDentroDe(raiz, entrada)) return true;
+    std::cout << "[AVISO] La carpeta de cache " << raiz << " esta dentro de la carpeta de entrada "
+              << entrada << ": se procesa sin cache de volumen." << std::endl;
+    return false;
+}
+
+std::unique_ptr<VolumeCache> VolumeCache::paraCarpeta(const std::string& raiz, const std::string& carpeta) {
+    if (!raizPermitida(raiz, carpeta)) return nullptr;
+    return std::unique_ptr<VolumeCache>(new VolumeCache(rutaParaCarpeta(raiz, carpeta)));
+}
+
+std::unique_ptr<VolumeCache> VolumeCache::paraSerie(const std::string& raiz, const SerieDicom& serie,
+                                                    const std::string& entrada) {
+    if (!raizPermitida(raiz, entrada) || !raizPermitida(raiz, serie.directorio)) return nullptr;
+    return std::unique_ptr<VolumeCache>(new VolumeCache(rutaParaSerie(raiz, serie)));
+}
+
+uint64_t VolumeCache::calcularHuella(const std::vector<std::string>& archivos) {
+    std::vector<std::string> ordenados(archivos);
+    std::sort(ordenados.begin(), ordenados.end());
+
+    uint64_t h = 14695981039346656037ULL;   // Base FNV-1a
+    mezclar(h, &VERSION_CACHE, sizeof(VERSION_CACHE));
+    for (const std::string& ruta : ordenados) {
+        mezclar(h, ruta.data(), ruta.size() + 1);
+        struct stat st;
+        int64_t datos[2] = {-1, -1};   // Archivo inaccesible: huella distinta
+        if (stat(ruta.c_str(), &st) == 0) {
+            datos[0] = (int64_t)st.st_size;
+            datos[1] = (int64_t)st.st_mtime;
+        }
+        mezclar(h, datos, sizeof(datos));
+    }
+    return h;
+}
+
+void VolumeCache::cerrar() {
+    // Las Mat ya entregadas conservan su propio mapeo: solo se suelta el descriptor
+    capas.clear();
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    escritura = false;
+    numCortes = alto = ancho = 0;
+    finArchivo = 0;
+}
+
+bool VolumeCache::abrir(uint64_t huella, VolumenCT& volumen) {
+    std::lock_guard<std::mutex> lock(mtx);
+    cerrar();
+
+    // 1. Abrir (en escritura si se puede, para ir completando las capas de ruido)
+    bool rw = true;
+    int f = ::open(rutaArchivo.c_str(), O_RDWR);
+    if (f < 0) {
+        rw = false;
+        f = ::open(rutaArchivo.c_str(), O_RDONLY);
+    }
+    if (f < 0) return false;
+
+    // 2. Validar la cabecera: formato, huella de los fuentes y tamaños
+    CabeceraDisco cab;
+    struct stat st;
+    bool valida = fstat(f, &st) == 0
+               && pread(f, &cab, sizeof(cab), 0) == (ssize_t)sizeof(cab)
+               && std::memcmp(cab.magia, MAGIA, sizeof(MAGIA)) == 0
+               && cab.version == VERSION_CACHE
+               && cab.bytesPixel == sizeof(PixelType)
+               && cab.numCortes > 0 && cab.alto > 0 && cab.ancho > 0
+               && cab.numCapas >= 0 && cab.numCapas <= MAX_CAPAS
+               && cab.bytesVoxeles == (uint64_t)cab.numCortes * cab.alto * cab.ancho * sizeof(PixelType)
+               && cab.offsetRutas + cab.bytesRutas <= (uint64_t)st.st_size
+               && cab.offsetVoxeles + cab.bytesVoxeles <= (uint64_t)st.st_size;
+    if (!valida) {
+        ::close(f);
+        return false;
+    }
+    if (cab.huella != huella) {
+        std::cout << "[CACHE] Los archivos de la serie cambiaron: se regenera " << rutaArchivo << std::endl;
+        ::close(f);
+        return false;
+    }
+
+    // 3. Orden de los cortes (rutas separadas por '\0')
+    std::string rutas(cab.bytesRutas, '\0');
+    if (pread(f, &rutas[0], rutas.size(), (off_t)cab.offsetRutas) != (ssize_t)rutas.size()) {
+        ::close(f);
+        return false;
+    }
+    std::vector<std::string> archivos;
+    for (size_t ini = 0; ini < rutas.size();) {
+        size_t fin = rutas.find('\0', ini);
+        if (fin == std::string::npos) fin = rutas.size();
+        archivos.push_back(rutas.substr(ini, fin - ini));
+        ini = fin + 1;
+    }
+    if ((int)archivos.size() != cab.numCortes) {
+        ::close(f);
+        return false;
+    }
+
+    // 4. Vóxeles: mapeo privado (copy-on-write), así una escritura accidental
+    // sobre el volumen nunca llega al archivo
+    std::shared_ptr<void> dueno;
+    uint8_t* voxeles = mapearRegion(f, cab.offsetVoxeles, cab.bytesVoxeles,
+                                    PROT_READ | PROT_WRITE, MAP_PRIVATE, dueno);
+    if (!voxeles) {
+        ::close(f);
+        return false;
+    }
+    // Lectura anticipada en segundo plano: el primer scroll no espera al disco
+    uintptr_t desfase = (uintptr_t)voxeles % (uintptr_t)sysconf(_SC_PAGESIZE);
+    madvise(voxeles - desfase, (size_t)cab.bytesVoxeles + desfase, MADV_WILLNEED);
+
+    volumen = VolumenCT();
+    volumen.numCortes = cab.numCortes;
+    volumen.alto = cab.alto;
+    volumen.ancho = cab.ancho;
+    for (int k = 0; k < 3; k++) volumen.espaciado[k] = cab.espaciado[k];
+    volumen.metadatos.pendiente = cab.pendiente;
+    volumen.metadatos.intercepto = cab.intercepto;
+    volumen.metadatos.espaciadoX = cab.espaciadoX;
+    volumen.metadatos.espaciadoY = cab.espaciadoY;
+    volumen.archivos = archivos;
+    volumen.datos = envolverBuffer(voxeles, cab.numCortes * cab.alto, cab.ancho, CV_16SC1, dueno);
+
+    fd = f;
+    escritura = rw;
+    numCortes = cab.numCortes;
+    alto = cab.alto;
+    ancho = cab.ancho;
+    finArchivo = (uint64_t)st.st_size;
+
+    // 5. Capas de reducción de ruido ya guardadas
+    for (int i = 0; i < cab.numCapas; i++) {
+        Capa capa;
+        capa.preset = cab.capas[i].preset;
+        capa.clahe = cab.capas[i].clahe != 0;
+        capa.huellaFiltro = cab.capas[i].huellaFiltro;
+        if (mapearCapa(capa, cab.capas[i].offset)) capas.push_back(capa);
+    }
+    return true;
+}
+
+bool VolumeCache::crear(const VolumenCT& volumen, uint64_t huella) {
+    std::lock_guard<std::mutex> lock(mtx);
+    cerrar();
+    if (volumen.vacio() || volumen.datos.type() != CV_16SC1) return false;
+
+    size_t barra = rutaArchivo.find_last_of('/');
+    if (barra != std::string::npos && barra > 0) ResultExporter::crearDirectorios(rutaArchivo.substr(0, barra));
+
+    // 1. Cabecera
+    std::string rutas;
+    for (const std::string& a : volumen.archivos) {
+        rutas += a;
+        rutas += '\0';
+    }
+    CabeceraDisco cab;
+    std::memset(&cab, 0, sizeof(cab));
+    std::memcpy(cab.magia, MAGIA, sizeof(MAGIA));
+    cab.version = VERSION_CACHE;
+    cab.bytesPixel = sizeof(PixelType);
+    cab.huella = huella;
+    cab.numCortes = volumen.numCortes;
+    cab.alto = volumen.alto;
+    cab.ancho = volumen.ancho;
+    for (int k = 0; k < 3; k++) cab.espaciado[k] = volumen.espaciado[k];
+    cab.pendiente = volumen.metadatos.pendiente;
+    cab.intercepto = volumen.metadatos.intercepto;
+    cab.espaciadoX = volumen.metadatos.espaciadoX;
+    cab.espaciadoY = volumen.metadatos.espaciadoY;
+    cab.offsetRutas = ALINEACION;
+    cab.bytesRutas = rutas.size();
+    cab.offsetVoxeles = alinear(cab.offsetRutas + cab.bytesRutas);
+    cab.bytesVoxeles = (uint64_t)volumen.numCortes * volumen.alto * volumen.ancho * sizeof(PixelType);
+
+    // 2. Escritura en un temporal: una caché a medias nunca queda con el nombre final.
+    // Un temporal por proceso e hilo: dos peticiones sobre la misma serie no se pisan.
+    std::string temporal = rutaArchivo + ".tmp" + std::to_string(getpid()) + "_"
+                         + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    FILE* f = std::fopen(temporal.c_str(), "wb");
+    if (!f) {
+        std::cerr << "[AVISO] No se pudo crear la cache de volumen " << rutaArchivo << std::endl;
+        return false;
+    }
+    bool ok = std::fwrite(&cab, sizeof(cab), 1, f) == 1
+           && std::fseek(f, (long)cab.offsetRutas, SEEK_SET) == 0
+           && std::fwrite(rutas.data(), 1, rutas.size(), f) == rutas.size()
+           && std::fseek(f, (long)cab.offsetVoxeles, SEEK_SET) == 0;
+    size_t bytesFila = (size_t)volumen.ancho * sizeof(PixelType);
+    if (ok && volumen.datos.isContinuous()) {
+        ok = std::fwrite(volumen.datos.data, 1, (size_t)cab.bytesVoxeles, f) == cab.bytesVoxeles;
+    } else {
+        for (int fila = 0; ok && fila < volumen.datos.rows; fila++) {
+            ok = std::fwrite(volumen.datos.ptr(fila), 1, bytesFila, f) == bytesFila;
+        }
+    }
+    ok = (std::fclose(f) == 0) && ok;
+
+    if (!ok || std::rename(temporal.c_str(), rutaArchivo.c_str()) != 0) {
+        std::remove(temporal.c_str());
+        std::cerr << "[AVISO] No se pudo escribir la cache de volumen " << rutaArchivo << std::endl;
+        return false;
+    }
+    std::cout << "[CACHE] Volumen guardado en " << rutaArchivo << " ("
+              << (cab.offsetVoxeles + cab.bytesVoxeles) / (1024 * 1024) << " MB)." << std::endl;
+    return true;
+}
+
+bool VolumeCache::mapearCapa(Capa& capa, uint64_t offset) {
+    uint64_t bytes = bytesCapa(numCortes, alto, ancho);
+    if (offset == 0 || offset + bytes > finArchivo) return false;
+    int proteccion = escritura ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    uint8_t* base = mapearRegion(fd, offset, (size_t)bytes, proteccion, MAP_SHARED, capa.mapeo);
+    if (!base) return false;
+    capa.validos = base;
+    capa.datos = base + alinear((uint64_t)numCortes);
+    return true;
+}
+
+VolumeCache::Capa* VolumeCache::buscarCapa(int preset, bool clahe, uint64_t huellaFiltro) {
+    for (Capa& c : capas) {
+        if (c.preset == preset && c.clahe == clahe && c.huellaFiltro == huellaFiltro) return &c;
+    }
+    return nullptr;
+}
+
+VolumeCache::Capa* VolumeCache::crearCapa(int preset, bool clahe, uint64_t huellaFiltro) {
+    if (!escritura) return nullptr;
+    int32_t numCapas = 0;
+    if (pread(fd, &numCapas, sizeof(numCapas), offsetof(CabeceraDisco, numCapas)) != (ssize_t)sizeof(numCapas)
+        || numCapas < 0 || numCapas >= MAX_CAPAS) {
+        return nullptr;
+    }
+
+    // 1. Ampliar el archivo: la región nueva queda a cero (todos los cortes sin calcular)
+    uint64_t offset = alinear(finArchivo);
+    uint64_t fin = offset + bytesCapa(numCortes, alto, ancho);
+    if (ftruncate(fd, (off_t)fin) != 0) return nullptr;
+    finArchivo = fin;
+
+    Capa capa;
+    capa.preset = preset;
+    capa.clahe = clahe;
+    capa.huellaFiltro = huellaFiltro;
+    if (!mapearCapa(capa, offset)) return nullptr;
+
+    // 2. Registrarla en la cabecera solo cuando ya existe en el archivo
+    CapaDisco entrada{preset, clahe ? 1 : 0, huellaFiltro, offset};
+    int32_t nuevas = numCapas + 1;
+    if (pwrite(fd, &entrada, sizeof(entrada), offsetof(CabeceraDisco, capas) + numCapas * sizeof(CapaDisco))
+            != (ssize_t)sizeof(entrada)
+        || pwrite(fd, &nuevas, sizeof(nuevas), offsetof(CabeceraDisco, numCapas)) != (ssize_t)sizeof(nuevas)) {
+        return nullptr;
+    }
+    capas.push_back(capa);
+    return &capas.back();
+}
+
+cv::Mat VolumeCache::corteFiltrado(int z, int preset, bool clahe, uint64_t huellaFiltro) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (fd < 0 || z < 0 || z >= numCortes) return cv::Mat();
+    Capa* capa = buscarCapa(preset, clahe, huellaFiltro);
+    if (!capa || !capa->validos[z]) return cv::Mat();
+    return envolverBuffer(capa->datos + (size_t)z * alto * ancho, alto, ancho, CV_8UC1, capa->mapeo);
+}
+
+bool VolumeCache::guardarFiltrado(int z, int preset, bool clahe, uint64_t huellaFiltro, const cv::Mat& img) {
+    if (img.type() != CV_8UC1) return false;
+    std::lock_guard<std::mutex> lock(mtx);
+    if (fd < 0 || !escritura || z < 0 || z >= numCortes || img.rows != alto || img.cols != ancho) return false;
+
+    Capa* capa = buscarCapa(preset, clahe, huellaFiltro);
+    if (!capa) capa = crearCapa(preset, clahe, huellaFiltro);
+    if (!capa) return false;
+
+    // Primero los píxeles y después el byte de validez
+    uint8_t* destino = capa->datos + (size_t)z * alto * ancho;
+    for (int fila = 0; fila < alto; fila++) {
+        std::memcpy(destino + (size_t)fila * ancho, img.ptr(fila), (size_t)ancho);
+    }
+    capa->validos[z] = 1;
+    return true;
+}
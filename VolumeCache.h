@@ -0,0 +1,96 @@
+#ifndef VOLUMECACHE_H
+#define VOLUMECACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct VolumenCT;
+struct SerieDicom;
+
+// Caché binaria de una serie ya decodificada, en una carpeta de cachés elegida por el
+// usuario (opcional: sin ella no se escribe nada). Nunca va junto a los DICOM, que pueden
+// estar en un archivo de solo lectura. Se abre con mmap: reabrir un estudio no vuelve a
+// pasar por ITK/GDCM.
+//
+// Disposición del archivo (todas las secciones alineadas a 4 KiB):
+//
+//   [cabecera 4 KiB] magia, versión, huella de los archivos fuente, geometría,
+//                    HU rescale y la tabla de capas de reducción de ruido
+//   [rutas]          un archivo por corte, en orden de posición ('\0' como separador)
+//   [vóxeles]        (numCortes*alto) x ancho CV_16S en HU, igual que VolumenCT::datos
+//   [capas]          opcionales: cortes 8 bits ya filtrados para un (preset, CLAHE, huella del filtro),
+//                    precedidos de un byte de validez por corte
+//
+// La huella se calcula con la ruta, el tamaño y la fecha de modificación de cada
+// DICOM de la carpeta: si cambia cualquiera, la caché se descarta y se regenera.
+class VolumeCache {
+public:
+    explicit VolumeCache(const std::string& ruta);
+    ~VolumeCache();
+
+    // <raiz>/<hash de la ruta absoluta de la carpeta>.vol
+    static std::string rutaParaCarpeta(const std::string& raiz, const std::string& carpeta);
+    // La misma ruta si la serie tiene la carpeta para ella sola; si no, el hash incluye el UID
+    static std::string rutaParaSerie(const std::string& raiz, const SerieDicom& serie);
+    // 'raiz' es 'carpeta' o está dentro de ella (rutas absolutas; la raíz puede no existir aún)
+    static bool raizDentroDe(const std::string& raiz, const std::string& carpeta);
+    // Raíz utilizable para los DICOM leídos de 'entrada': false (con [AVISO]) si está dentro
+    // de ese árbol, que puede ser un archivo de solo lectura. La usan el visor, el lote y el servidor.
+    static bool raizPermitida(const std::string& raiz, const std::string& entrada);
+
+    // Caché de una carpeta / de una serie leída de 'entrada'. nullptr sin raíz o si la raíz
+    // no está permitida: nunca se escribe nada dentro del árbol de los DICOM.
+    static std::unique_ptr<VolumeCache> paraCarpeta(const std::string& raiz, const std::string& carpeta);
+    static std::unique_ptr<VolumeCache> paraSerie(const std::string& raiz, const SerieDicom& serie,
+                                                  const std::string& entrada);
+
+    // Huella de los archivos fuente (FNV-1a sobre ruta, tamaño y mtime, en orden alfabético)
+    static uint64_t calcularHuella(const std::vector<std::string>& archivos);
+
+    // Mapea la caché si existe y su huella coincide. El volumen queda apuntando al
+    // mmap sin copiar (la Mat mantiene vivo el mapeo aunque se destruya la caché).
+    bool abrir(uint64_t huella, VolumenCT& volumen);
+
+    // Escribe la caché de un volumen recién decodificado (archivo temporal + rename)
+    bool crear(const VolumenCT& volumen, uint64_t huella);
+
+    // --- Capas de reducción de ruido (solo con la caché abierta en escritura) ---
+    // 'huellaFiltro' (ImageProcessor::huellaFiltro) separa las capas de modelos o ventanas HU
+    // distintos: cambiar de --modelo nunca devuelve los cortes filtrados con el anterior.
+    // Devuelve el corte filtrado guardado, o una Mat vacía si aún no se calculó
+    cv::Mat corteFiltrado(int z, int preset, bool clahe, uint64_t huellaFiltro);
+    // Guarda un corte filtrado (CV_8UC1 del tamaño del corte); crea la capa si hace falta
+    bool guardarFiltrado(int z, int preset, bool clahe, uint64_t huellaFiltro, const cv::Mat& img);
+
+    bool abierta() const { return fd >= 0; }
+    const std::string& ruta() const { return rutaArchivo; }
+
+private:
+    struct Capa {
+        int preset = -1;
+        bool clahe = false;
+        uint64_t huellaFiltro = 0;
+        uint8_t* validos = nullptr;   // Un byte por corte
+        uint8_t* datos = nullptr;     // numCortes * alto * ancho
+        std::shared_ptr<void> mapeo;
+    };
+
+    void cerrar();
+    Capa* buscarCapa(int preset, bool clahe, uint64_t huellaFiltro);
+    Capa* crearCapa(int preset, bool clahe, uint64_t huellaFiltro);
+    bool mapearCapa(Capa& capa, uint64_t offset);
+
+    std::string rutaArchivo;
+    int fd = -1;
+    bool escritura = false;
+    int numCortes = 0, alto = 0, ancho = 0;
+    uint64_t finArchivo = 0;
+    std::vector<Capa> capas;
+    std::mutex mtx;   // Las capas se consultan y amplían desde varios hilos (modo lote)
+};
+
+#endif
@@ -1,8 +1,25 @@
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
 #include <vector>
 #include <opencv2/opencv.hpp>
 #include "DicomHandler.h"
 #include "ImageProcessor.h"
+#include "BatchProcessor.h"
+#include "SliceCache.h"
+#include "PipelineCache.h"
+#include "Segmenter3D.h"
+#include "GuiRenderer.h"
+#include "Profiler.h"
+#include "ResultExporter.h"
+#include "VolumeCache.h"
+#include "MprReformatter.h"
+#include "RegionStats.h"
+#include "ProcessingServer.h"
+#include "SliceStore.h"
+#include "ContourExtractor.h"
+#include <sys/stat.h>
 
 using namespace cv;
 using namespace std;
@@ -22,30 +39,77 @@ struct AppState {
     bool usarDNN = false;
     bool usarMorf = true;
     bool verBordes = false;
+    bool usar3D = false;
+    int presetRuido = RUIDO_DNN;     // Preset de reducción de ruido (botón FILTRO)
+    double latenciaRuidoMs = 0.0;    // Última latencia medida del preset, por corte
+    bool verHUD = false;             // Panel de rendimiento (tecla 'h')
+    size_t reservasBuffers = 0;      // Reservas del espacio de trabajo (en régimen estable no crece)
+    bool verMPR = false;             // Vistas axial/coronal/sagital (tecla 'v')
+    int cursorX = -1, cursorY = -1;  // Cursor 3D de las vistas MPR (píxel del corte axial)
+    string resumenROI;               // Área y HU de la ROI del corte actual (título del panel 3)
     bool guardarSolicitado = false;
+    int estadoGuardado = 0;          // 0: nada, 1: escribiendo en segundo plano, 2: guardado (aviso)
+    int64 avisoHasta = 0;            // Fin del aviso "GUARDADO"
     
     // Navegación
     int indiceArchivo = 0;
     vector<string> archivos;
     bool necesitaActualizar = true;
+
+    // Botones del panel de control (los interruptores apuntan a los campos de arriba)
+    vector<Boton> botones;
 };
 
-// --- VARIABLES GLOBALES ---
-AppState app;
-vector<Boton> botones;
+// Lo que necesita el callback del ratón; llega por 'userdata' (sin variables globales)
+struct ContextoRaton {
+    AppState& app;
+    const GuiRenderer& gui;
+    const MprReformatter& mpr;
+};
+
+// Vistas de la reconstrucción multiplanar y el cursor con el que se calcularon
+struct VistasMPR {
+    Mat huCoronal, huSagital;      // HU remuestreadas (buffers reutilizados)
+    Mat gris;                      // Ventana HU intermedia
+    Mat axial, coronal, sagital;   // Listas para mostrar, con el cursor dibujado
+    int x = -1, y = -1, z = -1;
+    uint64_t versionOriginal = 0;
+    uint64_t version = 0;
+};
 
 // Paleta de Colores "Dark Medical"
-Scalar cFondo = Scalar(30, 30, 30);      // Gris Oscuro Fondo
-Scalar cPanel = Scalar(45, 45, 45);      // Gris Panel
-Scalar cTexto = Scalar(220, 220, 220);   // Blanco Texto
-Scalar cResaltado = Scalar(0, 120, 215); // Azul Resaltado
-Scalar cVerde = Scalar(80, 160, 80);     // Verde Activo
+const Scalar cFondo = Scalar(30, 30, 30);      // Gris Oscuro Fondo
+const Scalar cPanel = Scalar(45, 45, 45);      // Gris Panel
+const Scalar cTexto = Scalar(220, 220, 220);   // Blanco Texto
+const Scalar cResaltado = Scalar(0, 120, 215); // Azul Resaltado
+const Scalar cVerde = Scalar(80, 160, 80);     // Verde Activo
+
+// Cursor MPR: en el axial mueve (x, y); en el coronal (x, corte); en el sagital (y, corte)
+bool moverCursorMPR(AppState& app, const MprReformatter& mpr, const GuiRenderer& gui, Point p) {
+    Point2f q;
+    int z = app.indiceArchivo;
+    if (gui.aImagen(1, p, q)) { app.cursorX = (int)q.x; app.cursorY = (int)q.y; }
+    else if (gui.aImagen(2, p, q)) { app.cursorX = (int)q.x; z = mpr.corteDeFila((int)q.y); }
+    else if (gui.aImagen(3, p, q)) { app.cursorY = (int)q.x; z = mpr.corteDeFila((int)q.y); }
+    else return false;
+    if (z != app.indiceArchivo) { app.indiceArchivo = z; app.necesitaActualizar = true; }
+    return true;
+}
 
 // --- GESTIÓN DE EVENTOS DEL MOUSE ---
 void onMouse(int event, int x, int y, int flags, void* userdata) {
+    if (!userdata) return;
+    ContextoRaton& ctx = *static_cast<ContextoRaton*>(userdata);
+    AppState& app = ctx.app;
+
+    // Vistas MPR: clic o arrastre sobre los paneles mueve el cursor 3D
+    bool arrastre = (event == EVENT_MOUSEMOVE) && (flags & EVENT_FLAG_LBUTTON);
+    if (app.verMPR && ctx.mpr.listo() && (event == EVENT_LBUTTONDOWN || arrastre)) {
+        if (moverCursorMPR(app, ctx.mpr, ctx.gui, Point(x, y))) return;
+    }
     if (event == EVENT_LBUTTONDOWN) {
         // 1. Verificar Clics en Botones
-        for (auto& btn : botones) {
+        for (auto& btn : app.botones) {
             if (btn.zona.contains(Point(x, y))) {
                 if (btn.esAccion) {
                     if (btn.texto == "GUARDAR") app.guardarSolicitado = true;
@@ -61,6 +125,11 @@ void onMouse(int event, int x, int y, int flags, void* userdata) {
                     if (btn.texto == "HUESO") app.sliderModo = 1;
                     if (btn.texto == "PULMON") app.sliderModo = 2;
                     if (btn.texto == "TEJIDO") app.sliderModo = 3;
+                    // Preset de reducción de ruido: rota entre los disponibles
+                    if (btn.texto.compare(0, 7, "FILTRO:") == 0) {
+                        app.presetRuido = (app.presetRuido + 1) % NUM_PRESETS_RUIDO;
+                        btn.texto = string("FILTRO: ") + ImageProcessor::nombrePresetRuido(app.presetRuido);
+                    }
                 } else if (btn.estadoVinculado) {
                     // Interruptores (ON/OFF)
                     *btn.estadoVinculado = !(*btn.estadoVinculado);
@@ -80,46 +149,23 @@ void onMouse(int event, int x, int y, int flags, void* userdata) {
     }
 }
 
-// --- HELPER: DIBUJAR UN RECUADRO CON IMAGEN ---
-void ponerImagenEnGrid(Mat& lienzo, Mat& img, Rect zona, string titulo, Scalar colorBorde) {
-    if (img.empty()) return;
-    
-    // Fondo y borde del panel
-    rectangle(lienzo, zona, Scalar(20, 20, 20), -1);
-    rectangle(lienzo, zona, colorBorde, 1);
-    
-    // Título
-    rectangle(lienzo, Rect(zona.x, zona.y, zona.width, 25), colorBorde, -1);
-    putText(lienzo, titulo, Point(zona.x + 10, zona.y + 18), FONT_HERSHEY_SIMPLEX, 0.45, Scalar(255,255,255), 1);
+// --- CAPA ESTÁTICA (CHROME): fondo, barras laterales y títulos. Se dibuja una sola vez ---
+void dibujarChrome(Mat& fondo) {
+    fondo.setTo(cFondo);
 
-    // Ajuste de imagen (Mantener relación de aspecto)
-    Mat imgColor;
-    if(img.channels() == 1) cvtColor(img, imgColor, COLOR_GRAY2BGR);
-    else imgColor = img.clone();
+    // Barra lateral izquierda (Explorador)
+    rectangle(fondo, Rect(0, 0, 220, 768), cPanel, -1);
+    line(fondo, Point(220, 0), Point(220, 768), Scalar(60,60,60), 1);
+    putText(fondo, "EXPLORADOR DICOM", Point(15, 40), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(150,150,150), 1);
 
-    int hDisp = zona.height - 30; 
-    float scale = min((float)zona.width / imgColor.cols, (float)hDisp / imgColor.rows);
-    if (scale > 1.0f) scale = 1.0f; 
-
-    Mat imgRes;
-    resize(imgColor, imgRes, Size(), scale, scale);
-
-    int xOff = (zona.width - imgRes.cols) / 2;
-    int yOff = 30 + (hDisp - imgRes.rows) / 2;
-
-    imgRes.copyTo(lienzo(Rect(zona.x + xOff, zona.y + yOff, imgRes.cols, imgRes.rows)));
+    // Barra lateral derecha (Panel de Control)
+    rectangle(fondo, Rect(1366-220, 0, 220, 768), cPanel, -1);
+    line(fondo, Point(1366-220, 0), Point(1366-220, 768), Scalar(60,60,60), 1);
+    putText(fondo, "PANEL DE CONTROL", Point(1366-200, 40), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(150,150,150), 1);
 }
 
-// --- RENDERIZADO PRINCIPAL DE LA GUI ---
-void dibujarAppCompleta(Mat& lienzo, Mat& orig, Mat& proc, Mat& mask, Mat& final, string nombreArchivo) {
-    lienzo = Mat(768, 1366, CV_8UC3, cFondo);
-
-    // 1. BARRA LATERAL IZQUIERDA (Explorador)
-    Rect rSidebar(0, 0, 220, 768);
-    rectangle(lienzo, rSidebar, cPanel, -1);
-    line(lienzo, Point(220, 0), Point(220, 768), Scalar(60,60,60), 1);
-    putText(lienzo, "EXPLORADOR DICOM", Point(15, 40), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(150,150,150), 1);
-
+// 1. BARRA LATERAL IZQUIERDA: lista de archivos (depende solo del índice actual)
+void dibujarExplorador(const AppState& app, Mat& lienzo) {
     int yList = 100;
     // Mostrar 20 archivos alrededor del actual
     for (int i = max(0, app.indiceArchivo - 8); i < min((int)app.archivos.size(), app.indiceArchivo + 12); i++) {
@@ -132,33 +178,12 @@ void dibujarAppCompleta(Mat& lienzo, Mat& orig, Mat& proc, Mat& mask, Mat& final
         putText(lienzo, fname, Point(15, yList), FONT_HERSHEY_SIMPLEX, 0.4, col, 1);
         yList += 25;
     }
+}
 
-    // 2. ZONA CENTRAL (GRID 2x2)
-    int startX = 230;
-    int endX = 1366 - 230; 
-    int wTotal = endX - startX;
-    int hTotal = 768;
-    int wPanel = (wTotal - 30) / 2; 
-    int hPanel = (hTotal - 60) / 2; 
-
-    Rect r1(startX + 10, 20, wPanel, hPanel);              
-    Rect r2(startX + 20 + wPanel, 20, wPanel, hPanel);     
-    Rect r3(startX + 10, 30 + hPanel, wPanel, hPanel);     
-    Rect r4(startX + 20 + wPanel, 30 + hPanel, wPanel, hPanel); 
-
-    ponerImagenEnGrid(lienzo, orig, r1, "1. ORIGINAL (ITK Raw)", Scalar(100,100,100));
-    ponerImagenEnGrid(lienzo, proc, r2, "2. PROCESAMIENTO (CLAHE+DNN)", Scalar(100,100,100));
-    ponerImagenEnGrid(lienzo, mask, r3, "3. MASCARA BINARIA (ROI)", Scalar(100,100,100));
-    ponerImagenEnGrid(lienzo, final, r4, "4. RESULTADO FINAL (Overlay)", cResaltado);
-
-    // 3. BARRA LATERAL DERECHA (Panel de Control)
-    Rect rProps(1366-220, 0, 220, 768);
-    rectangle(lienzo, rProps, cPanel, -1);
-    line(lienzo, Point(1366-220, 0), Point(1366-220, 768), Scalar(60,60,60), 1);
-    putText(lienzo, "PANEL DE CONTROL", Point(1366-200, 40), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(150,150,150), 1);
-
+// 3. BARRA LATERAL DERECHA: botones y latencia del filtro de ruido
+void dibujarPanelControl(const AppState& app, Mat& lienzo) {
     // Dibujar todos los botones configurados
-    for (auto& btn : botones) {
+    for (auto& btn : app.botones) {
         Scalar bg = Scalar(60,60,60); // Color base
         
         // Si está activo (Switch ON)
@@ -182,10 +207,124 @@ void dibujarAppCompleta(Mat& lienzo, Mat& orig, Mat& proc, Mat& mask, Mat& final
                 Point(btn.zona.x + (btn.zona.width-ts.width)/2, btn.zona.y + (btn.zona.height+ts.height)/2), 
                 FONT_HERSHEY_SIMPLEX, 0.4, Scalar(255,255,255), 1);
     }
+
+    // Latencia del filtro de ruido (para elegir un preset que quepa en ~33 ms/fotograma)
+    if (app.usarDNN && app.latenciaRuidoMs > 0) {
+        char txt[64];
+        snprintf(txt, sizeof(txt), "Ruido: %.1f ms/corte", app.latenciaRuidoMs);
+        Scalar col = app.latenciaRuidoMs <= 33.0 ? cVerde : Scalar(0, 140, 255);
+        putText(lienzo, txt, Point(1366-200, 630), FONT_HERSHEY_SIMPLEX, 0.45, col, 1);
+    }
+
+    // Estado de la exportación (se escribe en segundo plano, la GUI no se detiene)
+    if (app.estadoGuardado == 1) putText(lienzo, "GUARDANDO...", Point(1366-200, 665), FONT_HERSHEY_SIMPLEX, 0.5, cTexto, 1);
+    if (app.estadoGuardado == 2) putText(lienzo, "GUARDADO EN DISCO!", Point(1366-200, 665), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0,255,0), 1);
+}
+
+// Firma del panel de control: cambia solo si cambia algo de lo que muestra
+size_t firmaPanelControl(const AppState& app) {
+    string estado = to_string(app.sliderModo);
+    for (auto& btn : app.botones) {
+        estado += btn.texto;
+        estado += (btn.estadoVinculado && *btn.estadoVinculado) ? '1' : '0';
+    }
+    if (app.usarDNN) estado += to_string((int)(app.latenciaRuidoMs * 10));
+    estado += to_string(app.estadoGuardado);
+    return hash<string>()(estado);
+}
+
+// HUD DE RENDIMIENTO: p50/p95 de cada etapa instrumentada (parte baja del explorador)
+void dibujarHUD(const AppState& app, Mat& lienzo) {
+    if (!app.verHUD) return;
+    int y = 622;
+    putText(lienzo, "RENDIMIENTO   p50 / p95 ms", Point(10, y), FONT_HERSHEY_SIMPLEX, 0.35, Scalar(150,150,150), 1);
+    y += 12;
+    putText(lienzo, "reservas buffers " + to_string(app.reservasBuffers), Point(10, y), FONT_HERSHEY_SIMPLEX, 0.33, cTexto, 1);
+    for (int e = 0; e < NUM_ETAPAS_PERF && y < 760; e++) {
+        Profiler::Resumen res = Profiler::global().resumen(e);
+        if (res.muestras == 0) continue;
+        y += 12;
+        char txt[64];
+        snprintf(txt, sizeof(txt), "%-16s %6.1f / %6.1f", Profiler::nombreEtapa(e), res.p50Ms, res.p95Ms);
+        putText(lienzo, txt, Point(10, y), FONT_HERSHEY_SIMPLEX, 0.33, cTexto, 1);
+    }
+}
+
+// --- VISTAS MPR ---
+// Solo se reformatea el plano cuyo índice cambió (coronal con y, sagital con x);
+// la ventana HU y el cursor se redibujan en los tres (coste despreciable)
+void actualizarMPR(const AppState& app, const MprReformatter& mpr, ImageProcessor& proc, const ResultadoPipeline& r,
+                   uint64_t versionOriginal, VistasMPR& m) {
+    int x = min(max(app.cursorX, 0), r.original.cols - 1);
+    int y = min(max(app.cursorY, 0), r.original.rows - 1);
+    int z = app.indiceArchivo;
+    if (x == m.x && y == m.y && z == m.z && versionOriginal == m.versionOriginal) return;
+
+    if (y != m.y) mpr.coronal(y, m.huCoronal);
+    if (x != m.x) mpr.sagital(x, m.huSagital);
+
+    Scalar cCursor(0, 200, 255);
+    int filaZ = mpr.filaDeCorte(z);
+    proc.aplicarContrastStretching(m.huCoronal, m.gris);
+    cvtColor(m.gris, m.coronal, COLOR_GRAY2BGR);
+    line(m.coronal, Point(x, 0), Point(x, m.coronal.rows - 1), cCursor, 1);
+    line(m.coronal, Point(0, filaZ), Point(m.coronal.cols - 1, filaZ), cCursor, 1);
+
+    proc.aplicarContrastStretching(m.huSagital, m.gris);
+    cvtColor(m.gris, m.sagital, COLOR_GRAY2BGR);
+    line(m.sagital, Point(y, 0), Point(y, m.sagital.rows - 1), cCursor, 1);
+    line(m.sagital, Point(0, filaZ), Point(m.sagital.cols - 1, filaZ), cCursor, 1);
+
+    cvtColor(r.original, m.axial, COLOR_GRAY2BGR);
+    line(m.axial, Point(x, 0), Point(x, m.axial.rows - 1), cCursor, 1);
+    line(m.axial, Point(0, y), Point(m.axial.cols - 1, y), cCursor, 1);
+
+    m.x = x; m.y = y; m.z = z;
+    m.versionOriginal = versionOriginal;
+    m.version++;
+}
+
+// --- RENDERIZADO PRINCIPAL DE LA GUI ---
+// Solo se re-rasterizan las regiones cuyo contenido cambió (ver GuiRenderer)
+void dibujarAppCompleta(const AppState& app, GuiRenderer& gui, const ResultadoPipeline& r, const VersionesPipeline& v,
+                        const VistasMPR& m) {
+    // 1. Explorador y HUD (el HUD se refresca como mucho 4 veces por segundo)
+    if (gui.region(0, Rect(0, 0, 220, 605), hash<int>()(app.indiceArchivo))) dibujarExplorador(app, gui.lienzoEditable());
+    size_t firmaHUD = app.verHUD ? (size_t)(getTickCount() / (getTickFrequency() / 4)) + 1 : 0;
+    if (gui.region(6, Rect(0, 605, 220, 163), firmaHUD)) dibujarHUD(app, gui.lienzoEditable());
+
+    // 2. ZONA CENTRAL (GRID 2x2)
+    int startX = 230;
+    int endX = 1366 - 230; 
+    int wTotal = endX - startX;
+    int hTotal = 768;
+    int wPanel = (wTotal - 30) / 2; 
+    int hPanel = (hTotal - 60) / 2; 
+
+    Rect r1(startX + 10, 20, wPanel, hPanel);              
+    Rect r2(startX + 20 + wPanel, 20, wPanel, hPanel);     
+    Rect r3(startX + 10, 30 + hPanel, wPanel, hPanel);     
+    Rect r4(startX + 20 + wPanel, 30 + hPanel, wPanel, hPanel); 
+
+    if (app.verMPR && !m.axial.empty()) {
+        // Reconstrucción multiplanar: los tres planos que pasan por el cursor
+        gui.panel(1, r1, m.axial, m.version, "1. AXIAL (corte " + to_string(m.z) + ")", Scalar(100,100,100));
+        gui.panel(2, r2, m.coronal, m.version, "2. CORONAL (y=" + to_string(m.y) + ")", Scalar(100,100,100));
+        gui.panel(3, r3, m.sagital, m.version, "3. SAGITAL (x=" + to_string(m.x) + ")", Scalar(100,100,100));
+    } else {
+        gui.panel(1, r1, r.original, v.original, "1. ORIGINAL (ITK Raw)", Scalar(100,100,100));
+        gui.panel(2, r2, r.procesada, v.procesada, "2. PROCESAMIENTO (CLAHE+DNN)", Scalar(100,100,100));
+        gui.panel(3, r3, r.mascara, v.mascara, "3. MASCARA (ROI) " + app.resumenROI, Scalar(100,100,100));
+    }
+    gui.panel(4, r4, r.final, v.final, "4. RESULTADO FINAL (Overlay)", cResaltado);
+
+    // 3. Panel de control
+    if (gui.region(5, Rect(1366-220, 0, 220, 768), firmaPanelControl(app))) dibujarPanelControl(app, gui.lienzoEditable());
 }
 
 // --- CONFIGURACIÓN DE LOS BOTONES ---
-void configurarBotones() {
+void configurarBotones(AppState& app) {
+    vector<Boton>& botones = app.botones;
     int x = 1366 - 200;
     int w = 180; int h = 35; int y = 80;
     
@@ -198,8 +337,10 @@ void configurarBotones() {
     // Grupo: Filtros
     botones.push_back({Rect(x,y,w,h), "CLAHE (Contraste)", &app.usarCLAHE, false}); y+=45;
     botones.push_back({Rect(x,y,w,h), "DNN (Ruido IA)", &app.usarDNN, false}); y+=45;
+    botones.push_back({Rect(x,y,w,h), string("FILTRO: ") + ImageProcessor::nombrePresetRuido(app.presetRuido), nullptr, true}); y+=45;
     botones.push_back({Rect(x,y,w,h), "MORFOLOGIA", &app.usarMorf, false}); y+=45;
-    botones.push_back({Rect(x,y,w,h), "VER BORDES", &app.verBordes, false}); y+=60;
+    botones.push_back({Rect(x,y,w,h), "VER BORDES", &app.verBordes, false}); y+=45;
+    botones.push_back({Rect(x,y,w,h), "SEGMENTACION 3D", &app.usar3D, false}); y+=60;
     
     // Grupo: Acciones
     botones.push_back({Rect(x,y,w/2-5,h), "<", nullptr, true});
@@ -207,6 +348,199 @@ void configurarBotones() {
     botones.push_back({Rect(x,680,w,50), "GUARDAR", nullptr, true});
 }
 
+// --- ESTADÍSTICAS DE LA ROI ---
+// Clave de la máscara medida: lo que cambia la ROI. Los bordes no cuentan (son solo
+// visuales) y el filtrado solo importa en el modo manual, que umbraliza la imagen procesada.
+size_t claveEstadisticas(const ConfiguracionPipeline& c, bool con3D) {
+    string k = to_string(c.modo) + (c.usarMorf ? "M" : "-") + (con3D ? "3" : "-");
+    if (c.modo == 0) k += to_string(c.usarCLAHE) + to_string(c.usarDNN) + to_string(c.presetRuido);
+    return hash<string>()(k);
+}
+
+// Mide la ROI del corte actual (la máscara del pipeline)
+void medirCorteActual(AppState& app, const ResultadoPipeline& r, RegionStats& stats) {
+    EstadisticasRegion e;
+    RegionStats::medir(r.hu, r.mascara, e);
+    stats.actualizarCorte(app.indiceArchivo, e);
+
+    char txt[64];
+    snprintf(txt, sizeof(txt), "%.1f cm2  %.0f+/-%.0f HU", stats.areaMm2(e) / 100.0, e.mediaHU(), e.desviacionHU());
+    app.resumenROI = txt;
+}
+
+// Mide los cortes de la serie que aún no tienen estadísticas, con la configuración actual.
+// 'mascaras3D' (opcional): máscara volumétrica comprimida del modo actual.
+void completarEstadisticas(ImageProcessor& proc, DicomHandler& dicomIO, const VolumenCT& volumen,
+                           const SliceStore& almacen, const vector<string>& archivos,
+                           const ConfiguracionPipeline& config, const SliceStore* mascaras3D, RegionStats& stats) {
+    ConfiguracionPipeline c = config;
+    c.verBordes = false;   // Solo hace falta la máscara, no sus contornos
+    Mat hu, roi, previa;
+    int nuevos = 0;
+    int64 t0 = getTickCount();
+    for (int z = 0; z < stats.numCortes(); z++) {
+        if (stats.corte(z).valida) continue;
+        if (almacen.tieneCorte(z)) almacen.obtenerCorte(z, hu);
+        else hu = volumen.vacio() ? dicomIO.cargarImagenDicom(archivos[z]) : volumen.corte(z);
+        if (hu.empty()) continue;
+        if (mascaras3D) mascaras3D->obtenerMascara(z, previa);
+        if (c.modo == 0 && previa.empty()) {
+            // El modo manual umbraliza la imagen filtrada: pasa por el pipeline completo
+            roi = proc.procesarCorte(hu, c).mascara;
+        } else {
+            // Los presets solo miran las HU: basta la segmentación
+            proc.segmentarSegunModo(hu, Mat(), c, previa, roi);
+        }
+        EstadisticasRegion e;
+        RegionStats::medir(hu, roi, e);
+        stats.actualizarCorte(z, e);
+        nuevos++;
+    }
+    cout << "[STATS] " << nuevos << " cortes medidos en "
+         << (getTickCount() - t0) * 1000.0 / getTickFrequency() << " ms." << endl;
+}
+
+// Volumen completo para la segmentación 3D: con la serie comprimida en memoria se
+// descomprime una copia temporal (el resto del visor solo descomprime el corte actual)
+VolumenCT volumenCompleto(const VolumenCT& volumen, const SliceStore& almacen) {
+    if (!volumen.vacio() || almacen.numCortes() == 0) return volumen;
+    VolumenCT copia = volumen;
+    copia.datos = almacen.obtenerVolumen();
+    return copia;
+}
+
+// --- VOLCADO DE LA INSTRUMENTACIÓN AL SALIR ---
+// Escribe <base>.json y <base>.csv con los percentiles de cada etapa
+void volcarRendimiento(const string& base) {
+    Profiler::global().imprimirResumen();
+    size_t barra = base.find_last_of("/");
+    if (barra != string::npos) mkdir(base.substr(0, barra).c_str(), 0755);
+    if (Profiler::global().exportarJSON(base + ".json") && Profiler::global().exportarCSV(base + ".csv")) {
+        cout << "[PERF] Latencias guardadas en " << base << ".json / .csv" << endl;
+    } else {
+        cout << "[AVISO] No se pudieron guardar las latencias en " << base << endl;
+    }
+}
+
+// --- MODO LOTE (SIN VENTANA) ---
+// Uso: IntegradorApp --batch <carpeta> [--mode manual|hueso|pulmon|tejido]
+//                    [--clahe] [--dnn] [--filtro dnn|nlm|nlm-rapido|bilateral|guiado]
+//                    [--sin-morf] [--bordes] [--3d] [--hilos N] [--lote N] [--modelo ruta.onnx]
+//                    [--perf base] [--formato png|bmp|raw] [--compresion 0-9] [--hilos-escritura N]
+//                    [--cache-vol carpeta] [--recursivo] [--memoria-mb N]
+//                    [--contornos] [--solo-contornos]
+int ejecutarModoLote(int argc, char** argv) {
+    ConfiguracionLote config;
+    string basePerf = "Resultados_Output/perf";
+    vector<string> args(argv, argv + argc);
+    for (size_t i = 1; i < args.size(); i++) {
+        const string& arg = args[i];
+        string error;
+        bool conValor = i + 1 < args.size();
+        if (leerOpcionPipeline(args, i, config.pipeline, error)) {
+            if (!error.empty()) { cout << "ERROR: " << error << endl; return -1; }
+        }
+        else if (arg == "--batch" && conValor) config.carpeta = args[++i];
+        else if (arg == "--hilos" && conValor) config.hilos = atoi(args[++i].c_str());
+        else if (arg == "--lote" && conValor) config.tamLoteDNN = atoi(args[++i].c_str());
+        else if (arg == "--modelo" && conValor) config.rutaModelo = args[++i];
+        else if (arg == "--perf" && conValor) basePerf = args[++i];
+        else if (arg == "--formato" && conValor) {
+            config.exportacion.formato = ResultExporter::formatoDesdeTexto(args[++i]);
+            if (config.exportacion.formato < 0) { cout << "ERROR: Formato desconocido '" << args[i] << "'." << endl; return -1; }
+        }
+        else if (arg == "--compresion" && conValor) config.exportacion.nivelPNG = atoi(args[++i].c_str());
+        else if (arg == "--hilos-escritura" && conValor) config.hilosEscritura = atoi(args[++i].c_str());
+        else if (arg == "--cache-vol" && conValor) config.carpetaCacheVolumen = args[++i];
+        else if (arg == "--recursivo") config.recursivo = true;
+        else if (arg == "--memoria-mb" && conValor) config.memoriaMaxMB = (size_t)atoi(args[++i].c_str());
+        else if (arg == "--contornos") config.exportarContornos = true;
+        else if (arg == "--solo-contornos") config.soloContornos = true;
+        else { cout << "ERROR: Argumento desconocido '" << arg << "'." << endl; return -1; }
+    }
+    if (config.carpeta.empty()) {
+        cout << "ERROR: --batch requiere la carpeta con imagenes." << endl;
+        return -1;
+    }
+
+    BatchProcessor lote(config);
+    int codigo = lote.ejecutar();
+    volcarRendimiento(basePerf);
+    return codigo;
+}
+
+// --- MODO SERVIDOR (PROCESO RESIDENTE) ---
+// Uso: IntegradorApp --servidor [--socket ruta] [--hilos N] [--lote N] [--modelo ruta.onnx]
+//                    [--cola N] [--conexiones N] [--espera-lote ms] [--salida carpeta]
+//                    [--formato png|bmp|raw] [--compresion 0-9] [--hilos-escritura N] [--cache-vol carpeta]
+//                    [--memoria-mb N] [--perf base]
+int ejecutarModoServidor(int argc, char** argv) {
+    ConfiguracionServidor config;
+    string basePerf = "Resultados_Output/perf_servidor";
+    vector<string> args(argv, argv + argc);
+    for (size_t i = 2; i < args.size(); i++) {
+        const string& arg = args[i];
+        bool conValor = i + 1 < args.size();
+        if (arg == "--socket" && conValor) config.socket = args[++i];
+        else if (arg == "--hilos" && conValor) config.hilos = atoi(args[++i].c_str());
+        else if (arg == "--lote" && conValor) config.tamLoteDNN = atoi(args[++i].c_str());
+        else if (arg == "--modelo" && conValor) config.rutaModelo = args[++i];
+        else if (arg == "--cola" && conValor) config.maxCortesEnCola = (size_t)atoi(args[++i].c_str());
+        else if (arg == "--conexiones" && conValor) config.maxConexiones = max(1, atoi(args[++i].c_str()));
+        else if (arg == "--espera-lote" && conValor) config.esperaLoteMs = atof(args[++i].c_str());
+        else if (arg == "--salida" && conValor) config.carpetaSalida = args[++i];
+        else if (arg == "--perf" && conValor) basePerf = args[++i];
+        else if (arg == "--formato" && conValor) {
+            config.exportacion.formato = ResultExporter::formatoDesdeTexto(args[++i]);
+            if (config.exportacion.formato < 0) { cout << "ERROR: Formato desconocido '" << args[i] << "'." << endl; return -1; }
+        }
+        else if (arg == "--compresion" && conValor) config.exportacion.nivelPNG = atoi(args[++i].c_str());
+        else if (arg == "--hilos-escritura" && conValor) config.exportacion.hilos = atoi(args[++i].c_str());
+        else if (arg == "--cache-vol" && conValor) config.carpetaCacheVolumen = args[++i];
+        else if (arg == "--memoria-mb" && conValor) config.memoriaMaxMB = (size_t)atoi(args[++i].c_str());
+        else { cout << "ERROR: Argumento desconocido '" << arg << "'." << endl; return -1; }
+    }
+
+    int codigo;
+    {
+        // El servidor se destruye (y para sus hilos) antes de volcar las latencias
+        ProcessingServer servidor(config);
+        codigo = servidor.ejecutar();
+    }
+    volcarRendimiento(basePerf);
+    return codigo;
+}
+
+// --- MODO CLIENTE ---
+// Uso: IntegradorApp --cliente <carpeta> [--socket ruta] [opciones del pipeline]
+//      IntegradorApp --cliente --estado | --apagar [--socket ruta]
+// Envía una petición al servidor e imprime su respuesta (código 0 si empieza por OK)
+int ejecutarModoCliente(int argc, char** argv) {
+    string socket = ConfiguracionServidor().socket;
+    string peticion;
+    vector<string> args(argv, argv + argc);
+    for (size_t i = 2; i < args.size(); i++) {
+        const string& arg = args[i];
+        if (arg == "--socket" && i + 1 < args.size()) socket = args[++i];
+        else if (arg == "--estado") peticion = "ESTADO";
+        else if (arg == "--apagar") peticion = "APAGAR";
+        else if (peticion.empty()) peticion = "PROCESAR \"" + arg + "\"";
+        else peticion += " " + arg;   // Opciones del pipeline: las valida el servidor
+    }
+    if (peticion.empty()) {
+        cout << "ERROR: --cliente requiere una carpeta, --estado o --apagar." << endl;
+        return -1;
+    }
+
+    string respuesta;
+    if (!ProcessingServer::enviarPeticion(socket, peticion, respuesta)) {
+        cout << "ERROR: No se pudo contactar con el servidor en " << socket << endl;
+        return -1;
+    }
+    cout << respuesta << endl;
+    return respuesta.compare(0, 2, "OK") == 0 ? 0 : -1;
+}
+
 // --- PUNTO DE ENTRADA PRINCIPAL ---
 int main(int argc, char** argv) {
     // 1. Verificar Argumentos
@@ -214,118 +548,297 @@ int main(int argc, char** argv) {
         cout << "ERROR: Arrastra la carpeta con imagenes al ejecutable." << endl; 
         return -1; 
     }
+    if (string(argv[1]) == "--batch") return ejecutarModoLote(argc, argv);
+    if (string(argv[1]) == "--servidor") return ejecutarModoServidor(argc, argv);
+    if (string(argv[1]) == "--cliente") return ejecutarModoCliente(argc, argv);
+
+    // Estado de la interfaz: vive en main y se pasa a quien lo necesita
+    AppState app;
+    MprReformatter mpr;
     
-    // 2. Cargar Lista de Archivos (Soporta .IMA y .dcm)
-    string p = string(argv[1]) + "/*.IMA";
-    glob(p, app.archivos, false);
-    if(app.archivos.empty()) glob(string(argv[1]) + "/*.dcm", app.archivos, false);
+    // Opciones del visor: [--cache-mb N] [--precarga N] [--hilos-dnn N] [--perf base]
+    //                    [--formato png|bmp|raw] [--compresion 0-9] [--cache-vol carpeta] [--serie N]
+    //                    [--memoria-mb N]
+    ConfiguracionExportacion confExport;
+    size_t cacheMB = 256;
+    int radioPrecarga = 4;
+    int hilosDNN = 0;
+    int indiceSerie = 0;
+    string basePerf = "Resultados_Output/perf";
+    string carpetaCacheVol;   // Vacío = sin caché de volumen
+    size_t memoriaMB = 0;   // 0 = sin límite: el volumen se queda descomprimido
+    vector<string> args(argv, argv + argc);
+    for (size_t i = 2; i < args.size(); i++) {
+        const string& arg = args[i];
+        bool conValor = i + 1 < args.size();
+        if (arg == "--cache-mb" && conValor) cacheMB = (size_t)atoi(args[++i].c_str());
+        else if (arg == "--precarga" && conValor) radioPrecarga = atoi(args[++i].c_str());
+        else if (arg == "--hilos-dnn" && conValor) hilosDNN = atoi(args[++i].c_str());
+        else if (arg == "--perf" && conValor) basePerf = args[++i];
+        else if (arg == "--formato" && conValor) {
+            confExport.formato = ResultExporter::formatoDesdeTexto(args[++i]);
+            if (confExport.formato < 0) { cout << "ERROR: Formato desconocido '" << args[i] << "'." << endl; return -1; }
+        }
+        else if (arg == "--compresion" && conValor) confExport.nivelPNG = atoi(args[++i].c_str());
+        else if (arg == "--cache-vol" && conValor) carpetaCacheVol = args[++i];
+        else if (arg == "--serie" && conValor) indiceSerie = atoi(args[++i].c_str());
+        else if (arg == "--memoria-mb" && conValor) memoriaMB = (size_t)atoi(args[++i].c_str());
+        // Un flag sin valor al final también se rechaza, como en el modo lote
+        else { cout << "ERROR: Argumento desconocido '" << arg << "'." << endl; return -1; }
+    }
+
+    // 2. Cargar la serie como volumen 3D (buffer contiguo, cortes ordenados por posición).
+    // Con la caché de volumen al día se mapea directamente, sin decodificar los DICOM.
+    // Si la carpeta no tiene DICOM directamente (árbol tipo Original_Data/...), se
+    // descubren las series de sus subcarpetas y se abre la elegida con --serie.
+    DicomHandler dicomIO;
+    VolumenCT volumen;
+    unique_ptr<VolumeCache> cacheVol;
+    vector<SerieDicom> series;
+    if (DicomHandler::buscarArchivos(argv[1]).empty()) {
+        series = DicomHandler::descubrirSeries(argv[1]);
+        for (size_t s = 0; s < series.size() && s < 20; s++) {
+            cout << "[SERIES] " << s << ": " << series[s].directorio << "  (" << series[s].archivos.size()
+                 << " cortes, " << series[s].descripcion << ")" << endl;
+        }
+        if (series.size() > 20) cout << "[SERIES] ... y " << series.size() - 20 << " mas (--serie N)." << endl;
+    }
+
+    int64 tInicio = getTickCount();
+    double espaciado[3] = {1.0, 1.0, 1.0};   // mm para las medidas (cm², ml)
+    if (!series.empty()) {
+        const SerieDicom& serie = series[min(max(indiceSerie, 0), (int)series.size() - 1)];
+        if (!carpetaCacheVol.empty()) cacheVol = VolumeCache::paraSerie(carpetaCacheVol, serie, argv[1]);
+        if (dicomIO.cargarSerieDicom(serie, volumen, cacheVol.get())) app.archivos = volumen.archivos;
+        else app.archivos = serie.archivos;
+        for (int k = 0; k < 3; k++) espaciado[k] = volumen.vacio() ? serie.espaciado[k] : volumen.espaciado[k];
+    } else {
+        if (!carpetaCacheVol.empty()) cacheVol = VolumeCache::paraCarpeta(carpetaCacheVol, argv[1]);
+        if (dicomIO.cargarVolumenDicom(argv[1], volumen, cacheVol.get())) {
+            app.archivos = volumen.archivos;
+            for (int k = 0; k < 3; k++) espaciado[k] = volumen.espaciado[k];
+        } else {
+            // Respaldo: Lista de Archivos (Soporta .IMA y .dcm), decodificados corte a corte.
+            // El espaciado sale de los encabezados de la serie (como en el modo lote)
+            app.archivos = DicomHandler::buscarArchivos(argv[1]);
+            vector<SerieDicom> encabezados = DicomHandler::descubrirSeries(argv[1], false);
+            if (!encabezados.empty()) {
+                const SerieDicom& serie = *max_element(encabezados.begin(), encabezados.end(),
+                    [](const SerieDicom& a, const SerieDicom& b) { return a.archivos.size() < b.archivos.size(); });
+                for (int k = 0; k < 3; k++) espaciado[k] = serie.espaciado[k];
+            }
+        }
+    }
+    if (!volumen.vacio()) {
+        cout << "[SISTEMA] Volumen cargado: " << volumen.numCortes << " cortes en "
+             << (getTickCount() - tInicio) * 1000.0 / getTickFrequency() << " ms." << endl;
+    }
     
     if(app.archivos.empty()) {
         cout << "ERROR: No se encontraron imagenes medicas en la carpeta." << endl;
         return -1;
     }
 
+    // Serie más grande que el techo de memoria: se guarda comprimida (sin pérdida) y solo
+    // se descomprime el corte que se está viendo
+    SliceStore almacen;
+    size_t bytesVolumen = (size_t)volumen.numCortes * volumen.alto * volumen.ancho * sizeof(PixelType);
+    if (!volumen.vacio() && memoriaMB > 0 && bytesVolumen > memoriaMB * 1024 * 1024) {
+        int64 tCompresion = getTickCount();
+        almacen.reiniciar(volumen.numCortes, volumen.alto, volumen.ancho);
+        almacen.guardarVolumen(volumen.datos);
+        volumen.datos.release();
+        almacen.imprimirResumen("Serie");
+        cout << "[MEMORIA] Compresion en " << (getTickCount() - tCompresion) * 1000.0 / getTickFrequency()
+             << " ms." << endl;
+    }
+    bool hayVolumen = !volumen.vacio() || almacen.numCortes() > 0;
+
     // 3. Inicializar Módulos
-    DicomHandler dicomIO; 
+    // La precarga asíncrona solo hace falta si la serie no entró como volumen
+    SliceCache cache(cacheMB * 1024 * 1024);
+    unique_ptr<SlicePrefetcher> precarga;
+    if (!hayVolumen) precarga.reset(new SlicePrefetcher(app.archivos, cache, radioPrecarga));
     ImageProcessor proc; 
     
-    // INTENTO DE CARGA DE MODELO (Try-Catch de Seguridad)
-    try {
-        proc.cargarRedNeuronal("dncnn.onnx"); 
-        cout << "[SISTEMA] Modelo de IA cargado correctamente." << endl;
-    } catch (...) {
-        cout << "[AVISO] No se encontro 'dncnn.onnx'. Usando algoritmo de respaldo." << endl;
-    }
-
-    configurarBotones();
+    // INTENTO DE CARGA DE MODELO (sin modelo se usa el filtro de respaldo)
+    proc.cargarRedNeuronal("dncnn.onnx");
+    if (proc.redDisponible()) cout << "[SISTEMA] Modelo de IA cargado correctamente." << endl;
+    else cout << "[AVISO] No se encontro 'dncnn.onnx'. Usando algoritmo de respaldo." << endl;
+    // OpenCV DNN (backend CPU) usa el pool de hilos global de OpenCV: lo decide la aplicación
+    if (hilosDNN > 0) setNumThreads(hilosDNN);
+    proc.configurarInferencia(8);
+
+    configurarBotones(app);
     
     string win = "MediVision Pro - Interfaz Clinica";
     namedWindow(win, WINDOW_NORMAL);
     resizeWindow(win, 1366, 768);
-    setMouseCallback(win, onMouse, 0); // Activar clics
 
-    Mat imgOrig, imgFinal, lienzo;
+    PipelineCache pipeline(proc);
+    // Los cortes filtrados también se guardan en la caché de volumen (siguiente sesión)
+    if (cacheVol && cacheVol->abierta() && hayVolumen) pipeline.usarCacheVolumen(cacheVol.get());
+    ResultExporter exportador(confExport);
+    Segmenter3D seg3D;
+    SliceStore mascaras3D[3][2];   // [modo Hueso/Pulmón][morfología]: una vez por volumen, comprimidas
+    Mat mascaraCorte3D;            // Corte actual de la máscara 3D (se descomprime al cambiar)
+    int claveCorte3D = -1;
+    Mat imgOrig;
+
+    // Lienzo persistente: el chrome se dibuja una vez, el resto solo cuando cambia
+    GuiRenderer gui(Size(1366, 768), cFondo);
+    dibujarChrome(gui.fondo());
+    gui.invalidar();
+    ContextoRaton ctxRaton{app, gui, mpr};
+    setMouseCallback(win, onMouse, &ctxRaton); // Activar clics (el renderizador traduce clics a píxeles de los paneles)
+    VistasMPR vistasMPR;
+    RegionStats estadisticas;
+    size_t claveStats = 0;
+    uint64_t versionStats = 0;   // Versión de la máscara ya medida
 
     // --- BUCLE PRINCIPAL DE LA APLICACIÓN ---
     while(true) {
-        // Cargar imagen solo si cambió el índice
+        // Cargar imagen solo si cambió el índice (vista del volumen, o caché de precarga)
         if(app.necesitaActualizar) {
-            imgOrig = dicomIO.cargarImagenDicom(app.archivos[app.indiceArchivo]);
+            if (almacen.numCortes() > 0) imgOrig = almacen.obtenerCorte(app.indiceArchivo);
+            else imgOrig = volumen.vacio() ? precarga->obtener(app.indiceArchivo) : volumen.corte(app.indiceArchivo);
             app.necesitaActualizar = false;
         }
         if(imgOrig.empty()) break;
 
         // --- PIPELINE DE PROCESAMIENTO ---
-        // 1. Estiramiento de Contraste (Base)
-        Mat imgProc = proc.aplicarContrastStretching(imgOrig);
-        // 2. Filtros Opcionales
-        imgProc = proc.mejorarContraste(imgProc, app.usarCLAHE);
-        imgProc = proc.aplicarReduccionRuido(imgProc, app.usarDNN);
-
-        // --- LÓGICA DE SEGMENTACIÓN ---
-        Mat mask;
-        Scalar colOverlay = Scalar(0,255,255); // Amarillo por defecto
-
-        switch(app.sliderModo) {
-            case 0: // Manual
-                inRange(imgProc, Scalar(50), Scalar(200), mask); 
-                break;
-            case 1: // Hueso (>200) + Cierre Morfológico
-                mask = proc.segmentarHueso(imgProc); 
-                colOverlay=Scalar(0,0,255); // Rojo
-                break;
-            case 2: // Pulmon (Inverso <60)
-                // Threshold Inverso para detectar aire
-                threshold(imgProc, mask, 60, 255, THRESH_BINARY_INV); 
-                colOverlay=Scalar(255,0,0); // Azul
-                break;
-            case 3: // Tejido (Rango Medio)
-                mask = proc.segmentarTejidoBlando(imgProc); 
-                colOverlay=Scalar(0,255,0); // Verde
-                break;
-        }
-
-        // --- REFINAMIENTO MORFOLÓGICO ADICIONAL ---
-        if (app.usarMorf) {
-            // Aplicar APERTURA (Opening) para quitar ruido en Pulmón y Tejido
-            if (app.sliderModo == 2 || app.sliderModo == 3 || app.sliderModo == 0) {
-                mask = proc.aplicarApertura(mask);
+        ConfiguracionPipeline config;
+        config.modo = app.sliderModo;
+        config.usarCLAHE = app.usarCLAHE;
+        config.usarDNN = app.usarDNN;
+        config.presetRuido = app.presetRuido;
+        config.usarMorf = app.usarMorf;
+        config.verBordes = app.verBordes;
+        config.usar3D = app.usar3D;
+
+        // Segmentación volumétrica (componentes conexas 3D) para Hueso y Pulmón
+        SliceStore* mascaraVolumen = nullptr;
+        Mat previa3D;
+        if (app.usar3D && hayVolumen && (app.sliderModo == 1 || app.sliderModo == 2)) {
+            mascaraVolumen = &mascaras3D[app.sliderModo][app.usarMorf ? 1 : 0];
+            if (mascaraVolumen->numCortes() == 0) {
+                int64 t3D = getTickCount();
+                bool hueso = (app.sliderModo == 1);
+                VolumenCT fuente = volumenCompleto(volumen, almacen);
+                Mat mVol = hueso ? seg3D.segmentarHueso3D(fuente, app.usarMorf)
+                                 : seg3D.segmentarPulmon3D(fuente, app.usarMorf);
+                seg3D.imprimirResumen(hueso ? "Hueso" : "Pulmon");
+                cout << "[3D] Segmentacion en " << (getTickCount() - t3D) * 1000.0 / getTickFrequency() << " ms." << endl;
+                mascaraVolumen->reiniciar(fuente.numCortes, fuente.alto, fuente.ancho);
+                mascaraVolumen->guardarMascaras(mVol);
+                mascaraVolumen->imprimirResumen(hueso ? "Mascara 3D Hueso" : "Mascara 3D Pulmon");
             }
-        } else {
-            // Si desactivan morfología, ensuciamos la máscara para demostrar la diferencia
-            if (app.sliderModo != 0) threshold(imgProc, mask, 150, 255, THRESH_BINARY); 
+            int clave = (app.indiceArchivo * 3 + app.sliderModo) * 2 + (app.usarMorf ? 1 : 0);
+            if (clave != claveCorte3D) {
+                mascaraVolumen->obtenerMascara(app.indiceArchivo, mascaraCorte3D);
+                claveCorte3D = clave;
+            }
+            previa3D = mascaraCorte3D;
         }
 
-        // --- DETECCIÓN DE BORDES / GRADIENTE ---
-        if(app.verBordes) {
-            // Técnica Nueva: Gradiente Morfológico
-            Mat bordesMorf = proc.aplicarGradienteMorfologico(mask);
-            
-            // Técnica Clásica: Canny
-            Mat bordesCanny = proc.detectarBordes(imgProc, 50, 150);
-            bitwise_and(bordesCanny, mask, bordesCanny); // Filtrar solo dentro del ROI
-            
-            // Combinar para visualización
-            cv::max(mask, bordesMorf, mask);
+        // Solo se recalculan las etapas cuyas entradas cambiaron
+        int64 tFotograma = getTickCount();
+        bool recalculado = pipeline.actualizar(app.indiceArchivo, imgOrig, config, previa3D);
+        if (recalculado) {
+            app.latenciaRuidoMs = proc.latenciaRuido(app.presetRuido);
+            app.reservasBuffers = proc.espacioTrabajo().reservas();
         }
 
-        // Generar resultado visual
-        imgFinal = proc.crearOverlay(imgProc, mask, colOverlay);
+        const ResultadoPipeline& r = pipeline.resultado();
+
+        // Estadísticas de la ROI: al cambiar la máscara se mide solo este corte y el total
+        // de la serie se corrige restando su medida anterior. Otra máscara = otra serie de medidas.
+        size_t clave = claveEstadisticas(config, mascaraVolumen != nullptr);
+        if (clave != claveStats) {
+            estadisticas.reiniciar((int)app.archivos.size(), espaciado, ImageProcessor::nombreModo(config.modo));
+            claveStats = clave;
+            versionStats = 0;
+        }
+        if (pipeline.versiones().mascara != versionStats) {
+            medirCorteActual(app, r, estadisticas);
+            versionStats = pipeline.versiones().mascara;
+        }
 
-        // --- RENDERIZADO FINAL ---
-        string fName = app.archivos[app.indiceArchivo].substr(app.archivos[app.indiceArchivo].find_last_of("/\\")+1);
-        dibujarAppCompleta(lienzo, imgOrig, imgProc, mask, imgFinal, fName);
+        // Vistas MPR del volumen (se reformatean al mover el cursor o cambiar de corte)
+        if (app.verMPR && mpr.listo()) {
+            if (app.cursorX < 0) { app.cursorX = volumen.ancho / 2; app.cursorY = volumen.alto / 2; }
+            actualizarMPR(app, mpr, proc, r, pipeline.versiones().original, vistasMPR);
+        }
 
-        // Feedback de Guardado
+        // Guardado asíncrono: se copian las 4 vistas y se escriben en segundo plano
         if(app.guardarSolicitado) {
-            proc.guardarResultados(fName, imgOrig, imgProc, mask, imgFinal);
-            putText(lienzo, "GUARDADO EN DISCO!", Point(550, 380), FONT_HERSHEY_SIMPLEX, 1.5, Scalar(0,255,0), 3);
+            string fName = app.archivos[app.indiceArchivo].substr(app.archivos[app.indiceArchivo].find_last_of("/\\")+1);
+            if (exportador.encolar(fName, r.original, r.procesada, r.mascara, r.final, true, false)) {
+                app.estadoGuardado = 1;
+            } else {
+                cout << "[AVISO] Cola de exportacion llena: no se guardo " << fName << endl;
+            }
+            // Con VER BORDES se guardan también los contornos vectoriales del corte
+            if (config.verBordes) {
+                if (!exportador.encolarContornos(fName, r.contornos, app.indiceArchivo, app.archivos[app.indiceArchivo],
+                                                 espaciado, ImageProcessor::nombreModo(config.modo), false)) {
+                    cout << "[AVISO] Cola de exportacion llena: no se guardaron los contornos de " << fName << endl;
+                }
+            }
             app.guardarSolicitado = false;
-            imshow(win, lienzo); waitKey(500); // Pausa para ver el mensaje
+        }
+        // Feedback de Guardado en el panel de control (sin pausar el bucle)
+        if (app.estadoGuardado == 1 && exportador.pendientes() == 0) {
+            cout << " [GUARDADO] Imagenes guardadas en carpeta: " << confExport.carpeta << endl;
+            app.estadoGuardado = 2;
+            app.avisoHasta = getTickCount() + (int64)(1.5 * getTickFrequency());
+        }
+        if (app.estadoGuardado == 2 && getTickCount() > app.avisoHasta) app.estadoGuardado = 0;
+
+        // --- RENDERIZADO (solo las regiones que cambiaron; sin cambios no se hace nada) ---
+        int64 tDibujo = getTickCount();
+        dibujarAppCompleta(app, gui, r, pipeline.versiones(), vistasMPR);
+
+        if (gui.presentar(win)) {
+            int64 tFin = getTickCount();
+            Profiler::global().registrar(PERF_DIBUJO, tFin - tDibujo);
+            Profiler::global().registrar(PERF_FOTOGRAMA, tFin - tFotograma);
+        } else if (recalculado) {
+            Profiler::global().registrar(PERF_FOTOGRAMA, getTickCount() - tFotograma);
         }
 
-        imshow(win, lienzo);
-        if(waitKey(10) == 27) break; // ESC para salir
+        int tecla = waitKey(10);
+        if(tecla == 27) break; // ESC para salir
+        if(tecla == 'h') app.verHUD = !app.verHUD;
+        // Estadísticas del estudio: se miden los cortes que faltan y se exportan en CSV y JSON
+        if(tecla == 'e') {
+            completarEstadisticas(proc, dicomIO, volumen, almacen, app.archivos, config, mascaraVolumen, estadisticas);
+            estadisticas.imprimirResumen();
+            string base = confExport.carpeta + "/estadisticas_" + ImageProcessor::nombreModo(config.modo);
+            ResultExporter::crearDirectorios(confExport.carpeta);
+            if (estadisticas.exportarCSV(base + ".csv", app.archivos) && estadisticas.exportarJSON(base + ".json", app.archivos)) {
+                cout << "[STATS] Estadisticas guardadas en " << base << ".csv / .json" << endl;
+            } else {
+                cout << "[AVISO] No se pudieron guardar las estadisticas en " << base << endl;
+            }
+        }
+        // Vistas MPR: la copia traspuesta del volumen se prepara la primera vez
+        if(tecla == 'v') {
+            if (!hayVolumen) {
+                cout << "[AVISO] Las vistas MPR necesitan la serie cargada como volumen." << endl;
+            } else {
+                // La copia traspuesta solo vive mientras se ven las vistas. Con la serie
+                // comprimida se rellena corte a corte: no hay otra copia descomprimida.
+                app.verMPR = !app.verMPR;
+                if (!app.verMPR) mpr.liberar();
+                else if (volumen.vacio()) mpr.asignarAlmacen(almacen, volumen);
+                else mpr.asignarVolumen(volumen);
+                gui.invalidar();
+            }
+        }
     }
+    exportador.esperar();
+    exportador.imprimirResumen();
+    volcarRendimiento(basePerf);
     return 0;
 }
\ No newline at end of file